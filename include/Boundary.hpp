@@ -2,12 +2,15 @@
 
 #include <vector>
 
+#include "BoundaryTable.hpp"
 #include "Cell.hpp"
 #include "Fields.hpp"
 /**
  * @brief Abstact of boundary conditions.
  *
- * This class patches the physical values to the given field.
+ * This class patches the physical values to the given field. The cell-wise
+ * branches of a boundary only run once in compile(), which records the updates
+ * in flat tables; apply() and apply_pressures() just run these tables.
  */
 class Boundary {
   public:
@@ -17,9 +20,53 @@ class Boundary {
      *
      * @param[in] Field to be applied
      */
-    virtual void apply(Fields &field) = 0;
+    void apply(Fields &field);
     virtual ~Boundary() = default;
-    virtual void apply_pressures(Fields &field) = 0;
+
+    /**
+     * @brief Patches the pressure boundary condition, called after every
+     * pressure iteration
+     *
+     * @param[in] Field to be applied
+     */
+    void apply_pressures(Fields &field);
+
+    /**
+     * @brief Patches only the temperature boundary condition, called before
+     * every temperature substep
+     *
+     * @param[in] Field to be applied
+     */
+    void apply_temperatures(Fields &field);
+
+    /**
+     * @brief Builds the update tables, has to be called once before apply()
+     *
+     * @param[in] Field the tables are built for, gives the matrix sizes and
+     * whether the energy equation is on
+     * @param[in] Grid holding the border flags of the boundary cells
+     */
+    virtual void compile(Fields &field, const Grid &grid) = 0;
+
+    /**
+     * @brief Advances time dependent boundary values over the last timestep,
+     * called once per timestep before apply()
+     *
+     * @param[in] Field to be applied, holding the size of the last timestep
+     */
+    virtual void advance(Fields &/*field*/) {}
+
+  protected:
+    /// empty tables for the matrices of the given field
+    void reset_tables(Fields &field);
+
+    /// velocity, temperature and pressure updates of apply()
+    BoundaryTable _u_table;
+    BoundaryTable _v_table;
+    BoundaryTable _t_table;
+    BoundaryTable _p_table;
+    /// pressure updates of apply_pressures(), independent of each other
+    BoundaryTable _pressure_table;
 };
 
 /**
@@ -31,8 +78,7 @@ class FixedWallBoundary : public Boundary {
     FixedWallBoundary(std::vector<Cell *> cells);
     FixedWallBoundary(std::vector<Cell *> cells, double wall_temperature);
     virtual ~FixedWallBoundary() = default;
-    virtual void apply(Fields &field);
-    virtual void apply_pressures(Fields &field);
+    virtual void compile(Fields &field, const Grid &grid);
 
   private:
     std::vector<Cell *> _cells;
@@ -48,8 +94,7 @@ class AdiabaticWallBoundary : public Boundary {
   public:
     AdiabaticWallBoundary(std::vector<Cell *> cells);
     virtual ~AdiabaticWallBoundary() = default;
-    virtual void apply(Fields &field);
-    virtual void apply_pressures(Fields &field);
+    virtual void compile(Fields &field, const Grid &grid);
 
   private:
     std::vector<Cell *> _cells;
@@ -65,8 +110,7 @@ class MovingWallBoundary : public Boundary {
     MovingWallBoundary(std::vector<Cell *> cells, double wall_velocity);
     MovingWallBoundary(std::vector<Cell *> cells, std::map<int, double> wall_velocity, double wall_temperature);
     virtual ~MovingWallBoundary() = default;
-    virtual void apply(Fields &field);
-    virtual void apply_pressures(Fields &field);
+    virtual void compile(Fields &field, const Grid &grid);
 
   private:
     std::vector<Cell *> _cells;
@@ -85,8 +129,7 @@ class InFlow : public Boundary {
     InFlow(std::vector<Cell *> cells, std::map<int, double> inlet_velocity);
     InFlow(std::vector<Cell *> cells, std::map<int, double> inlet_velocity, double wall_temperature);
     virtual ~InFlow() = default;
-    virtual void apply(Fields &field);
-    virtual void apply_pressures(Fields &field);
+    virtual void compile(Fields &field, const Grid &grid);
 
   private:
     std::vector<Cell *> _cells;
@@ -104,11 +147,55 @@ class OutFlow : public Boundary {
     OutFlow(std::vector<Cell *> cells, double outlet_pressure);
     OutFlow(std::vector<Cell *> cells, double wall_temperature, double outlet_pressure);
     virtual ~OutFlow() = default;
-    virtual void apply(Fields &field);
-    virtual void apply_pressures(Fields &field);
+    virtual void compile(Fields &field, const Grid &grid);
 
   private:
     std::vector<Cell *> _cells;
     double _wall_temperature;
     double _outlet_pressure;
 };
+
+/**
+ * @brief Convective (non-reflecting) outflow boundary condition for the outer
+ * boundaries of the domain.
+ * The velocities on the boundary follow du/dt + c du/dn = 0 with the outflow
+ * velocity c, so disturbances are carried out of the domain instead of being
+ * reflected. Dirichlet for pressure.
+ *
+ * The transport is discretized implicitly upwind,
+ * u_b^(n+1) = (u_b^n + C u_f) / (1 + C) with C = c dt / h and u_f the value on
+ * the fluid side, which is stable for any timestep.
+ */
+class ConvectiveOutFlow : public Boundary {
+  public:
+    ConvectiveOutFlow(std::vector<Cell *> cells, double outlet_pressure);
+    virtual ~ConvectiveOutFlow() = default;
+    virtual void compile(Fields &field, const Grid &grid);
+    virtual void advance(Fields &field);
+
+  private:
+    /// one boundary velocity value transported from its fluid side neighbour
+    struct Transport {
+        /// flat indices of the boundary value and of its fluid side neighbour
+        int target;
+        int fluid;
+        /// flat index of the normal velocity of the same border, in u if normal_in_u
+        int normal;
+        bool normal_in_u;
+        /// +1 if the outflow points in the positive direction of the normal velocity, -1 otherwise
+        double sign;
+        /// cell size normal to the border
+        double spacing;
+        /// boundary value of the previous timestep
+        double value;
+    };
+
+    /// adds the transport of the matrix element (i, j) from (fi, fj)
+    void add(std::vector<Transport> &transports, const Matrix<double> &matrix, int i, int j, int fi, int fj,
+             int normal, bool normal_in_u, double sign, double spacing);
+
+    std::vector<Cell *> _cells;
+    double _outlet_pressure;
+    std::vector<Transport> _u_transports;
+    std::vector<Transport> _v_transports;
+};
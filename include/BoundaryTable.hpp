@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * @brief One precompiled boundary update on flat matrix indices
+ *
+ * target = scale * ((constant + c1 * source1) + c2 * source2)
+ *
+ * This form reproduces all of the boundary formulas with their original order
+ * of operations, e.g. 0.5 * (4 Tw - a - b) or -0.5 * (a + b).
+ */
+struct BoundaryUpdate {
+    int target;
+    int source1;
+    int source2;
+    double c1;
+    double c2;
+    double constant;
+    double scale;
+};
+
+/**
+ * @brief Ordered list of boundary updates for one field
+ *
+ * The boundary classes compile their branch chains once into such tables,
+ * so that applying a boundary condition is a flat gather/scatter loop.
+ */
+class BoundaryTable {
+  public:
+    BoundaryTable() = default;
+
+    /**
+     * @brief Empty table for matrices with the given number of elements in x direction
+     *
+     * @param stride number of elements in x direction, used to flatten (i, j)
+     */
+    explicit BoundaryTable(int stride);
+
+    /// target(i, j) = value
+    void set(int i, int j, double value);
+
+    /// target(i, j) = constant + coeff * source(si, sj)
+    void set(int i, int j, double coeff, int si, int sj, double constant = 0.0);
+
+    /// target(i, j) = scale * ((constant + c1 * source(si1, sj1)) + c2 * source(si2, sj2))
+    void set(int i, int j, double scale, double constant, double c1, int si1, int sj1, double c2, int si2, int sj2);
+
+    /**
+     * @brief Runs all updates in the order they were added, so that later
+     * updates see the values written by earlier ones
+     *
+     * @param source data the sources are read from
+     * @param target data the targets are written to, may be source
+     */
+    void apply(const double *source, double *target) const;
+
+    /**
+     * @brief Runs all updates with the threads of the OpenMP team, only valid
+     * if no update reads a target of another one
+     *
+     * @param source data the sources are read from
+     * @param target data the targets are written to, may be source
+     */
+    void apply_parallel(const double *source, double *target) const;
+
+    /// whether there is nothing to update
+    bool empty() const { return _updates.empty(); }
+
+  private:
+    int index(int i, int j) const { return _stride * j + i; }
+
+    int _stride{0};
+    std::vector<BoundaryUpdate> _updates;
+};
@@ -1,15 +1,19 @@
 #pragma once
 
+#include <initializer_list>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "Boundary.hpp"
+#include "Communication.hpp"
 #include "Discretization.hpp"
 #include "Domain.hpp"
 #include "Fields.hpp"
 #include "Grid.hpp"
 #include "PressureSolver.hpp"
+#include "SimdKernels.hpp"
+#include "Threading.hpp"
 
 /**
  * @brief Class to hold and orchestrate the simulation flow.
@@ -71,12 +75,53 @@ class Case {
     // Worksheet 3 Additions
     int _iproc{1};
     int _jproc{1};
+    /// whether iproc and jproc were chosen by choose_process_grid() rather than given
+    bool _auto_process_grid{false};
     int _process_rank{0};
     int _size{1};
 
     // Project Additions
     std::string _solver_type;
     int _num_levels{2};
+    /// smoother sweeps per pass over the grid in the multigrid solvers
+    int _mg_block_sweeps{4};
+    /// requested instruction set of the row kernels ("auto", "scalar", "sse2", "avx2", "avx512")
+    std::string _simd{"auto"};
+    /// instruction set actually used
+    simd_isa _simd_isa{simd_isa::SCALAR};
+    /// fuse the flux/RHS and velocity/CFL sweeps ("on") or run them separately ("off")
+    std::string _fused_step{"on"};
+    /// threads per process, 0 keeps the OpenMP default
+    int _num_threads{1};
+    /// treatment of the diffusion terms ("explicit" or "implicit")
+    std::string _diffusion{"explicit"};
+    /// tolerance of the implicit diffusion solves
+    double _diffusion_tolerance{1e-6};
+    /// relative change of the fields per unit time below which the flow counts as steady, 0 turns detection off
+    double _steady_tolerance{0.0};
+    /// time span the flow has to stay steady before the run stops
+    double _steady_window{1.0};
+    /// pressure boundary conditions applied to the ghost cells after every PPE iteration ("ghost") or folded into
+    /// the stencil of the solver ("folded")
+    std::string _pressure_bc{"ghost"};
+    /// time integration of the predictors ("euler", "ab2" or "rk3")
+    std::string _time_integrator{"euler"};
+    /// temperature in substeps of its own stable timestep within every momentum step ("on") or not ("off")
+    std::string _energy_subcycling{"off"};
+    /// cuts of the domain into subdomains of equal size ("uniform") or of equal fluid cell count ("balanced")
+    std::string _decomposition{"uniform"};
+    /// halos of neighbours on the same node read from shared memory ("shared") or sent as messages ("messages")
+    std::string _halo_exchange{"shared"};
+    /// ghost layers of the Jacobi pressure solvers, i.e. sweeps per pressure halo exchange, as requested
+    int _requested_halo_depth{1};
+    /// ghost layers actually used, at most the smallest subdomain size, see fit_halo_depth()
+    int _halo_depth{1};
+    /// timesteps between checks of the load balance, 0 keeps the decomposition for the whole run
+    int _rebalance_interval{0};
+    /// ratio of the largest to the mean work of the processes above which the domain is cut again
+    double _rebalance_threshold{1.1};
+    /// fluid cells of the whole domain as read for the first rebalancing, rank 0 only
+    Matrix<double> _cell_weights;
 
     Fields _field;
     Grid _grid;
@@ -91,6 +136,24 @@ class Case {
     /// Maximum number of iterations for the solver
     int _max_iter;
 
+    /// relaxation factor of the pressure solvers
+    double _omg;
+
+    /// boundary values, kept to build the boundaries of a new subdomain
+    double _hot_temperature{0.0};
+    double _cold_temperature{0.0};
+    double _inflow_velocity{0.0};
+    double _outlet_pressure{0.0};
+
+    /// Number of fluid cells of all processes, the weight of the RMS residuals
+    double _fluid_cells{0.0};
+
+    /// Persistent halo exchanges of the fields, set up once the fields exist
+    HaloExchange _temperature_halo;
+    HaloExchange _flux_halo;
+    HaloExchange _pressure_halo;
+    HaloExchange _velocity_halo;
+
     /**
      * @brief Creating file names from given input data file
      *
@@ -101,6 +164,52 @@ class Case {
      */
     void set_file_names(std::string file_name);
 
+    /**
+     * @brief One stage of the timestep: temperatures, fluxes, pressure Poisson
+     * equation and velocities, with the halo exchanges in between
+     *
+     * @param[in,out] iter_count PPE iterations, increased by the ones of this stage
+     * @return double RMS residual of the last PPE iteration
+     */
+    double advance_stage(int &iter_count);
+
+    /**
+     * @brief Advances the temperature over the last momentum step in substeps
+     * of its own stable timestep, with the halo exchanges in between
+     *
+     * @param[in] temperature_dt stable timestep of the temperature over all processes
+     * @return int number of substeps taken
+     */
+    int subcycle_temperatures(double temperature_dt);
+
+    /**
+     * @brief Starts the reduction of the changes of u, v, p and T over all
+     * processes, see state_change_rate()
+     *
+     * @param[out] change non-blocking reduction of the changes and magnitudes
+     */
+    void start_state_change(Reduction &change);
+
+    /**
+     * @brief Relative change of u, v, p and T per unit time over all processes,
+     * see Fields::state_change_rate(). The first sample of a run counts as an
+     * infinite change.
+     *
+     * @param[in] change reduction started by start_state_change()
+     * @param[in] dt timestep size of the last step
+     * @return double relative change per unit time, NaN once the run diverged
+     */
+    double state_change_rate(Reduction &change, double dt);
+
+    /**
+     * @brief Implicit diffusion solve, sweeps until the RMS residual drops below
+     * the diffusion tolerance or the maximum number of iterations is reached
+     *
+     * @param[in] sweep one Gauss-Seidel sweep of Fields returning the local squared residual
+     * @param[in] halo exchange of the swept fields, run after every sweep
+     */
+    void solve_diffusion(double (Fields::*sweep)(Grid &), HaloExchange &halo);
+
     /**
      * @brief Solution file outputter
      *
@@ -117,4 +226,29 @@ class Case {
                     double Tc, double Th, int my_rank);
     std::ofstream simulation_log_file(int my_rank = 0);
     void build_domain(Domain &domain, int imax_domain, int jmax_domain);
+    /// subdomain of this process and its neighbours from the cuts of the domain
+    void place_subdomain(Domain &domain);
+    /// creates the pressure solver of the given type, folding in the boundaries of the grid if requested
+    void build_pressure_solver();
+    /// limits the requested halo depth to the smallest subdomain of the current decomposition
+    void fit_halo_depth();
+    /// creates and compiles the boundaries of the grid
+    void build_boundaries();
+    /**
+     * @brief Cuts the domain again if the processes are busy for too different
+     * times, and moves the grid, fields, boundaries, pressure solver and halos
+     * onto the new subdomains
+     *
+     * Every fluid cell is weighted with the time per fluid cell its process
+     * took, and the domain is cut by Decomposition::balanced() for the same
+     * process grid. Collective.
+     *
+     * @param[in] busy_time own work of this process in the timesteps since the last call, without waiting and output
+     * @return double largest over mean work if the domain was cut again, 0 otherwise
+     */
+    double rebalance(double busy_time);
+    /// picks iproc and jproc for the number of processes, with the least work and halo of the busiest process
+    void choose_process_grid(int imax_domain, int jmax_domain);
+    /// work of every interior cell of the whole domain for the balanced decomposition, one per fluid cell
+    Matrix<double> fluid_weights(int imax_domain, int jmax_domain) const;
 };
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <array>
-#include <vector>
 
 #include "Enums.hpp"
 
@@ -47,18 +46,10 @@ class Cell {
      */
     void set_neighbour(Cell *cell, border_position position);
 
-    /**
-     * @brief Access to the borders where fluid cells exist
-     *
-     * @param[out] vector of borders where fluid cells exist
-     */
-    const std::vector<border_position> &borders() const;
-
     /**
      * @brief Append new border to the cell
      *
-     * Sets the corresponding border to true and adds the border
-     * to the container
+     * Sets the corresponding border to true
      *
      * @param[in] border position where fluid cell exists
      */
@@ -93,8 +84,6 @@ class Cell {
 
     /// Vector of bools that holds border conditions. TOP-BOTTOM-LEFT-RIGHT
     std::array<bool, 4> _border{false, false, false, false};
-    /// Vector of border positions that holds existing borders
-    std::vector<border_position> _borders;
     /// Pointers to neighbours. // TOP -  BOTTOM - LEFT - RIGHT - NORTHWEST -
     /// SOUTEAST
     std::array<Cell *, 6> _neighbours;
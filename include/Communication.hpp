@@ -2,6 +2,99 @@
 #include "Datastructures.hpp"
 #include "Domain.hpp"
 
+#include <array>
+#include <initializer_list>
+#include <vector>
+
+/**
+ * @brief Persistent halo exchange of a fixed set of field matrices, set up
+ * once by Communication::init_exchange() and run any number of times by
+ * Communication::start_exchange() and Communication::finish_exchange()
+ *
+ * Neighbours on other nodes get their strips as messages. A neighbour on the
+ * same node reads them straight from this process' shared memory window
+ * instead, after an empty message tells it they are ready. Each side has two
+ * strips used in turns, so one exchange can be written while the neighbour
+ * may still read the previous one.
+ *
+ * Sides are numbered like Domain::neighbour_ranks.
+ */
+struct HaloExchange {
+    HaloExchange() = default;
+    HaloExchange(const HaloExchange &) = delete;
+    HaloExchange &operator=(const HaloExchange &) = delete;
+    /// frees the persistent requests and windows, unless MPI is already finalized
+    ~HaloExchange();
+
+    /// matrices whose halos are exchanged
+    std::vector<Matrix<double> *> matrices;
+    const Domain *domain{nullptr};
+    /// number of ghost lines per side, the matrices hold size_x + 2 * width by size_y + 2 * width cells
+    int width{1};
+    /// the strips of all matrices of one side, one after the other
+    std::array<std::vector<double>, 4> send;
+    std::array<std::vector<double>, 4> receive;
+    /// persistent receives of the four sides, then sends of the four sides, MPI_REQUEST_NULL without neighbour
+    std::array<MPI_Request, 8> requests{MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL,
+                                        MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    /// whether an exchange was started and not finished yet
+    bool in_flight{false};
+
+    /// whether the neighbour of a side is on the same node and exchanges through shared memory
+    std::array<bool, 4> shared{false, false, false, false};
+    /// shared windows holding the two strips of each side, MPI_WIN_NULL without shared memory
+    std::array<MPI_Win, 4> windows{MPI_WIN_NULL, MPI_WIN_NULL, MPI_WIN_NULL, MPI_WIN_NULL};
+    /// own strips of a shared side, written for the neighbour
+    std::array<double *, 4> outbox{nullptr, nullptr, nullptr, nullptr};
+    /// strips of the neighbour of a shared side that are meant for this process
+    std::array<const double *, 4> inbox{nullptr, nullptr, nullptr, nullptr};
+    /// which of the two strips the current exchange uses
+    int turn{0};
+
+    bool active() const { return in_flight; }
+};
+
+/**
+ * @brief Several scalars reduced across all processors in a single collective
+ * call, each with its own operation
+ *
+ * The values are added with sum(), min() and max(), which return the slot
+ * their result is read from with operator[] after reduce(), or after start()
+ * and finish() for a non-blocking reduction that overlaps other work.
+ */
+class Reduction {
+  public:
+    /// adds a value to be summed up, returns its slot
+    int sum(double value);
+    /// adds a value whose minimum is taken, returns its slot
+    int min(double value);
+    /// adds a value whose maximum is taken, returns its slot
+    int max(double value);
+
+    /// reduces all values added so far, blocking
+    void reduce();
+    /// starts the reduction of all values added so far
+    void start();
+    /// waits for the reduction started by start()
+    void finish();
+
+    /// result of the given slot once the reduction is done
+    double operator[](int slot) const { return _entries[slot].value; }
+
+    /// operation and value of one slot, the operation travels with the value
+    struct Entry {
+        double operation;
+        double value;
+    };
+
+  private:
+    int add(double operation, double value);
+
+    std::vector<Entry> _entries;
+    std::vector<Entry> _results;
+    MPI_Request _request{MPI_REQUEST_NULL};
+};
+
 /**
  * @brief Main Class which encapsulates the communication part of the
  * Problem
@@ -24,6 +117,35 @@ class Communication {
      *
      */
     static void finalize();
+    /**
+     * @brief Arranges the processes in an iproc x jproc Cartesian topology
+     *
+     * MPI may renumber the processes, so that neighbouring subdomains end up
+     * on the same node. All communication afterwards goes through
+     * communicator(), with the new ranks.
+     *
+     * @param iproc number of processes in x direction
+     * @param jproc number of processes in y direction
+     * @param rank rank of this process in the topology
+     * @param shared_memory whether neighbours on the same node exchange halos through shared memory
+     */
+    static void create_topology(int iproc, int jproc, int &rank, bool shared_memory = true);
+    /**
+     * @brief Communicator of the processes, the Cartesian one once created
+     */
+    static MPI_Comm communicator();
+    /**
+     * @brief Position of a process in the topology
+     *
+     * @param rank rank in the topology
+     * @return std::array<int, 2> zero based process indices in x and y direction
+     */
+    static std::array<int, 2> coordinates(int rank);
+    /**
+     * @brief Ranks of the left, right, bottom and top neighbours of this
+     * process in the topology, -1 where there is none
+     */
+    static std::array<int, 4> neighbours();
     /**
      * @brief Method to abort the program due to bad user inputs
      *
@@ -32,10 +154,20 @@ class Communication {
     /**
      * @brief MPI method to find minimum value across dt across all processors
      *
+     * Single values are reduced with one MPI_Allreduce, several of them should
+     * go through a Reduction.
+     *
      * @param dt dt value across different processors
      * @return double returns the minimum value of the dt across all processors and broadcasts to all processors
      */
     static double reduce_min(double dt);
+    /**
+     * @brief MPI method to find the maximum of a value across all processors
+     *
+     * @param value local value
+     * @return double returns the maximum value across all processors and broadcasts to all processors
+     */
+    static double reduce_max(double value);
     /**
      * @brief MPI method to find sum of a value across all processors
      *
@@ -44,10 +176,70 @@ class Communication {
      */
     static double reduce_sum(double res);
     /**
-     * @brief MPI method to communicate field matrixes across the boundary of different processors
+     * @brief Runs a halo exchange set up by init_exchange() to completion
+     *
+     * @param halo exchange to run, must not be active
+     */
+    static void communicate(HaloExchange &halo);
+    /**
+     * @brief Sets up the persistent messages of a halo exchange of several
+     * field matrices, which share one message per neighbour and phase
      *
-     * @param matrix the field matrix whose values need to be communicated
+     * Collective over the processes of a node, which allocate the shared
+     * memory windows together.
+     *
+     * @param matrices the field matrices whose values need to be communicated
      * @param domain domain details of the processor
+     * @param halo exchange to set up, an earlier setup is released
+     * @param width number of ghost lines per side, every neighbour needs at least as many interior lines
+     */
+    static void init_exchange(std::initializer_list<Matrix<double> *> matrices, const Domain &domain,
+                              HaloExchange &halo, int width = 1);
+    /**
+     * @brief Starts a halo exchange set up by init_exchange(), so the caller
+     * can compute cells that need no halo values in the meantime
+     *
+     * The columns go to the left and right neighbours right away. The rows
+     * carry the corner values received from them, so they follow in
+     * finish_exchange(). The matrices must not be written until then.
+     *
+     * @param halo exchange to start, must not be active
+     */
+    static void start_exchange(HaloExchange &halo);
+    /**
+     * @brief Completes a halo exchange started by start_exchange(), does
+     * nothing if none is active
+     *
+     * @param halo state of the exchange
+     */
+    static void finish_exchange(HaloExchange &halo);
+    /**
+     * @brief Releases the requests and shared memory windows of a halo
+     * exchange, collective over the processes of a node
+     *
+     * @param halo exchange to release, it has to be set up again before use
+     */
+    static void free_exchange(HaloExchange &halo);
+    /**
+     * @brief Moves field matrices from one decomposition of the domain to
+     * another one with the same process grid
+     *
+     * Each cell goes from the process that owned it, i.e. had it inside its
+     * subdomain or on the outer boundary of the domain, to every process
+     * whose new subdomain or ghost layer contains it, in one MPI_Alltoallv.
+     * The matrices are replaced by ones of the new subdomain size, with the
+     * ghost layers towards the neighbours already filled. Collective.
+     *
+     * @param matrices the field matrices to move, sized for from
+     * @param from domain details of the processor the matrices belong to
+     * @param to domain details of the processor afterwards
+     */
+    static void migrate(const std::vector<Matrix<double> *> &matrices, const Domain &from, const Domain &to);
+    /**
+     * @brief Time spent so far waiting for halo exchanges and reductions to
+     * complete, the rest of the run time of a process is its own work
+     *
+     * @return double seconds since init_parallel()
      */
-    static void communicate(Matrix<double> &matrix, const Domain &domain);
+    static double wait_time();
 };
\ No newline at end of file
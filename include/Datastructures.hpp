@@ -41,16 +41,16 @@ template <typename T> class Matrix {
      * @param[in] y index
      * @param[out] reference to the value
      */
-    T &operator()(int i, int j) { return _container.at(_imax * j + i); }
+    T &operator()(int i, int j) { return _container[_imax * j + i]; }
 
     /**
      * @brief Element access using index
      *
      * @param[in] x index
      * @param[in] y index
-     * @param[out] value of the element
+     * @param[out] const reference to the element
      */
-    T operator()(int i, int j) const { return _container.at(_imax * j + i); }
+    const T &operator()(int i, int j) const { return _container[_imax * j + i]; }
 
     /**
      * @brief Pointer representation of underlying data
@@ -59,6 +59,9 @@ template <typename T> class Matrix {
      */
     const T *data() const { return _container.data(); }
 
+    /// mutable pointer to the beginning of the vector, e.g. for the row kernels
+    T *data() { return _container.data(); }
+
     /**
      * @brief Access of the size of the structure
      *
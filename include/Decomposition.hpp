@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "Datastructures.hpp"
+
+/**
+ * @brief Splits of the domain into iproc x jproc subdomains
+ *
+ * A split is given by its cuts along one axis: process column I covers the
+ * interior columns cuts[I] + 1 to cuts[I + 1] of the whole domain, so there
+ * are iproc + 1 cuts from 0 to imax. Cutting both axes straight through the
+ * domain keeps every subdomain with at most one neighbour per side.
+ */
+class Decomposition {
+  public:
+    /**
+     * @brief Equally sized parts, the remainder goes to the last one
+     *
+     * @param cells number of interior cells along the axis
+     * @param parts number of processes along the axis
+     * @return std::vector<int> parts + 1 cuts
+     */
+    static std::vector<int> uniform(int cells, int parts);
+
+    /**
+     * @brief Cuts that balance the work of the subdomains
+     *
+     * Both axes are cut alternately, each time minimizing the largest work of a
+     * subdomain for the fixed cuts of the other axis, until that no longer
+     * improves. Every part keeps at least one cell.
+     *
+     * @param weights work of every interior cell, (0, 0) is the lower left one
+     * @param iproc number of processes in x direction
+     * @param jproc number of processes in y direction
+     * @param x_cuts iproc + 1 cuts in x direction
+     * @param y_cuts jproc + 1 cuts in y direction
+     */
+    static void balanced(const Matrix<double> &weights, int iproc, int jproc, std::vector<int> &x_cuts,
+                         std::vector<int> &y_cuts);
+
+    /**
+     * @brief Largest work of a subdomain of the given cuts
+     *
+     * @param weights work of every interior cell
+     * @param x_cuts cuts in x direction
+     * @param y_cuts cuts in y direction
+     */
+    static double max_work(const Matrix<double> &weights, const std::vector<int> &x_cuts,
+                           const std::vector<int> &y_cuts);
+
+    /**
+     * @brief Process grid for a number of processes
+     *
+     * Every iproc x jproc = size that leaves each process at least one cell is
+     * cut, and the one whose busiest subdomain has the least work plus halo
+     * cells is chosen, a halo cell counting like a cell of work. Ties go to
+     * the smaller total halo.
+     *
+     * @param weights work of every interior cell
+     * @param size number of processes
+     * @param balanced whether the subdomains are cut by balanced() or uniform()
+     * @return std::array<int, 2> iproc and jproc
+     */
+    static std::array<int, 2> process_grid(const Matrix<double> &weights, int size, bool balanced);
+};
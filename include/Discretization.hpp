@@ -1,10 +1,38 @@
 #pragma once
 
+#include <cmath>
+
 #include "Datastructures.hpp"
+#include "Enums.hpp"
+
+/**
+ * @brief Cell sizes and upwinding factor together with their precomputed
+ * reciprocals. Passed by value into the kernels so that the compiler can keep
+ * them in registers instead of reloading globals inside the stencil loops.
+ *
+ */
+struct Stencil {
+    Stencil() = default;
+    Stencil(double dx, double dy, double gamma)
+        : dx(dx), dy(dy), gamma(gamma), inv_dx(1.0 / dx), inv_dy(1.0 / dy), inv_dx2(1.0 / (dx * dx)),
+          inv_dy2(1.0 / (dy * dy)) {}
+
+    double dx{1.0};
+    double dy{1.0};
+    double gamma{0.0};
+    double inv_dx{1.0};
+    double inv_dy{1.0};
+    double inv_dx2{1.0};
+    double inv_dy2{1.0};
+};
 
 /**
  * @brief Static discretization methods to modify the fields
  *
+ * The stencils are available in two flavours: the templated kernels, which are
+ * instantiated per physics configuration (upwind scheme and uniform spacing) and
+ * take the stencil coefficients as an argument, and the plain static methods,
+ * which use the coefficients set by the constructor and the general hybrid scheme.
  */
 class Discretization {
   public:
@@ -13,21 +41,23 @@ class Discretization {
     /**
      * @brief Constructor to set the discretization parameters
      *
+     * Also selects the kernel configuration, i.e. the upwind scheme from the
+     * value of gamma and whether the grid spacing is uniform.
+     *
      * @param[in] cell size in x direction
      * @param[in] cell size in y direction
      * @param[in] upwinding coefficient
      */
     Discretization(double dx, double dy, double gamma);
 
-    /**
-     * @brief Diffusion discretization in 2D using central differences
-     *
-     * @param[in] data to be discretized
-     * @param[in] x index
-     * @param[in] y index
-     *
-     */
-    static double diffusion(const Matrix<double> &A, int i, int j);
+    /// Upwind scheme selected from gamma
+    upwind_scheme scheme() const { return _scheme; }
+
+    /// Whether dx == dy
+    bool uniform() const { return _uniform; }
+
+    /// Stencil coefficients of the discretization
+    static const Stencil &stencil() { return _stencil; }
 
     /**
      * @brief Convection in x direction using donor-cell scheme
@@ -36,6 +66,7 @@ class Discretization {
      * @param[in] y-velocity field
      * @param[in] x index
      * @param[in] y index
+     * @param[in] stencil coefficients
      * @param[out] result
      *
      * \f$\fraction{\partial u^2}{\partial x} =
@@ -48,7 +79,33 @@ class Discretization {
      * + 0.25*\gamma/dy)*(|V(i,j)+V(i+1,j)|*(U(i,j)-U(i,j+1))-|V(i,j-1)+V(i+1,j-1)|*(U(i,j-1)-U(i,j)))\f$
      *
      */
-    static double convection_u(const Matrix<double> &U, const Matrix<double> &V, int i, int j);
+    template <upwind_scheme Scheme, bool Uniform>
+    static double convection_u(const Matrix<double> &U, const Matrix<double> &V, int i, int j, const Stencil &s) {
+        const double u_e = U(i, j) + U(i + 1, j);
+        const double u_w = U(i - 1, j) + U(i, j);
+        const double v_n = V(i, j) + V(i + 1, j);
+        const double v_s = V(i, j - 1) + V(i + 1, j - 1);
+
+        double du2dx = u_e * u_e - u_w * u_w;
+        double duvdy = v_n * (U(i, j) + U(i, j + 1)) - v_s * (U(i, j - 1) + U(i, j));
+
+        if constexpr (Scheme != upwind_scheme::CENTRAL) {
+            double up_x = std::abs(u_e) * (U(i, j) - U(i + 1, j)) - std::abs(u_w) * (U(i - 1, j) - U(i, j));
+            double up_y = std::abs(v_n) * (U(i, j) - U(i, j + 1)) - std::abs(v_s) * (U(i, j - 1) - U(i, j));
+            if constexpr (Scheme == upwind_scheme::HYBRID) {
+                up_x *= s.gamma;
+                up_y *= s.gamma;
+            }
+            du2dx += up_x;
+            duvdy += up_y;
+        }
+
+        if constexpr (Uniform) {
+            return 0.25 * s.inv_dx * (du2dx + duvdy);
+        } else {
+            return 0.25 * (s.inv_dx * du2dx + s.inv_dy * duvdy);
+        }
+    }
 
     /**
      * @brief Convection in y direction using donor-cell scheme
@@ -57,6 +114,7 @@ class Discretization {
      * @param[in] y-velocity field
      * @param[in] x index
      * @param[in] y index
+     * @param[in] stencil coefficients
      * @param[out] result
      *
      * \f$\fraction{\partial uv}{\partial x} =
@@ -67,21 +125,73 @@ class Discretization {
      * (0.25/dy)*((V_(i,j)+V_(i,j+1))*(V_(i,j)+V_(i,j+1)) - (V_(i,j-1)+V_(i,j))*(V_(i,j-1)+V_(i,j)))
      * + (0.25*\gamma/dy)*(|V(i,j)+V(i,j+1)|*(V(i,j)-V(i,j+1))-|V(i,j-1)+V(i,j)|*(V(i,j-1)-V(i,j)))\f$
      */
-    static double convection_v(const Matrix<double> &U, const Matrix<double> &V, int i, int j);
+    template <upwind_scheme Scheme, bool Uniform>
+    static double convection_v(const Matrix<double> &U, const Matrix<double> &V, int i, int j, const Stencil &s) {
+        const double u_e = U(i, j) + U(i, j + 1);
+        const double u_w = U(i - 1, j) + U(i - 1, j + 1);
+        const double v_n = V(i, j) + V(i, j + 1);
+        const double v_s = V(i, j - 1) + V(i, j);
+
+        double duvdx = u_e * (V(i, j) + V(i + 1, j)) - u_w * (V(i - 1, j) + V(i, j));
+        double dv2dy = v_n * v_n - v_s * v_s;
+
+        if constexpr (Scheme != upwind_scheme::CENTRAL) {
+            double up_x = std::abs(u_e) * (V(i, j) - V(i + 1, j)) - std::abs(u_w) * (V(i - 1, j) - V(i, j));
+            double up_y = std::abs(v_n) * (V(i, j) - V(i, j + 1)) - std::abs(v_s) * (V(i, j - 1) - V(i, j));
+            if constexpr (Scheme == upwind_scheme::HYBRID) {
+                up_x *= s.gamma;
+                up_y *= s.gamma;
+            }
+            duvdx += up_x;
+            dv2dy += up_y;
+        }
+
+        if constexpr (Uniform) {
+            return 0.25 * s.inv_dx * (duvdx + dv2dy);
+        } else {
+            return 0.25 * (s.inv_dx * duvdx + s.inv_dy * dv2dy);
+        }
+    }
 
     /**
      * @brief Convection for Temperature using donor-cell scheme
      *
+     * @param[in] temperature field
      * @param[in] x-velocity field
      * @param[in] y-velocity field
      * @param[in] x index
      * @param[in] y index
+     * @param[in] stencil coefficients
      * @param[out] result
      *
-     * Need to write
+     * \f$\fraction{\partial uT}{\partial x} = (0.5/dx)*(U(i,j)*(T(i,j)+T(i+1,j)) - U(i-1,j)*(T(i-1,j)+T(i,j)))
+     * + (0.5*\gamma/dx)*(|U(i,j)|*(T(i,j)-T(i+1,j)) - |U(i-1,j)|*(T(i-1,j)-T(i,j)))\f$
      *
+     * and analogously for \f$\fraction{\partial vT}{\partial y}\f$
      */
-    static double convection_t(const Matrix<double> &T, const Matrix<double> &U, const Matrix<double> &V, int i, int j);
+    template <upwind_scheme Scheme, bool Uniform>
+    static double convection_t(const Matrix<double> &T, const Matrix<double> &U, const Matrix<double> &V, int i, int j,
+                               const Stencil &s) {
+        double dutdx = (T(i, j) + T(i + 1, j)) * U(i, j) - (T(i - 1, j) + T(i, j)) * U(i - 1, j);
+        double dvtdy = (T(i, j) + T(i, j + 1)) * V(i, j) - (T(i, j - 1) + T(i, j)) * V(i, j - 1);
+
+        if constexpr (Scheme != upwind_scheme::CENTRAL) {
+            double up_x = std::abs(U(i, j)) * (T(i, j) - T(i + 1, j)) - std::abs(U(i - 1, j)) * (T(i - 1, j) - T(i, j));
+            double up_y = std::abs(V(i, j)) * (T(i, j) - T(i, j + 1)) - std::abs(V(i, j - 1)) * (T(i, j - 1) - T(i, j));
+            if constexpr (Scheme == upwind_scheme::HYBRID) {
+                up_x *= s.gamma;
+                up_y *= s.gamma;
+            }
+            dutdx += up_x;
+            dvtdy += up_y;
+        }
+
+        if constexpr (Uniform) {
+            return 0.5 * s.inv_dx * (dutdx + dvtdy);
+        } else {
+            return 0.5 * (s.inv_dx * dutdx + s.inv_dy * dvtdy);
+        }
+    }
 
     /**
      * @brief Laplacian term discretization using central difference
@@ -89,10 +199,18 @@ class Discretization {
      * @param[in] data to be discretized
      * @param[in] x index
      * @param[in] y index
+     * @param[in] stencil coefficients
      * @param[out] result
      *
      */
-    static double laplacian(const Matrix<double> &P, int i, int j);
+    template <bool Uniform> static double laplacian(const Matrix<double> &P, int i, int j, const Stencil &s) {
+        if constexpr (Uniform) {
+            return (P(i + 1, j) + P(i - 1, j) + P(i, j + 1) + P(i, j - 1) - 4.0 * P(i, j)) * s.inv_dx2;
+        } else {
+            return (P(i + 1, j) - 2.0 * P(i, j) + P(i - 1, j)) * s.inv_dx2 +
+                   (P(i, j + 1) - 2.0 * P(i, j) + P(i, j - 1)) * s.inv_dy2;
+        }
+    }
 
     /**
      * @brief Terms of laplacian needed for SOR, i.e. excluding unknown value at
@@ -101,10 +219,49 @@ class Discretization {
      * @param[in] data to be discretized
      * @param[in] x index
      * @param[in] y index
+     * @param[in] stencil coefficients
      * @param[out] result
      *
      */
-    static double sor_helper(const Matrix<double> &P, int i, int j);
+    template <bool Uniform> static double sor_helper(const Matrix<double> &P, int i, int j, const Stencil &s) {
+        if constexpr (Uniform) {
+            return (P(i + 1, j) + P(i - 1, j) + P(i, j + 1) + P(i, j - 1)) * s.inv_dx2;
+        } else {
+            return (P(i + 1, j) + P(i - 1, j)) * s.inv_dx2 + (P(i, j + 1) + P(i, j - 1)) * s.inv_dy2;
+        }
+    }
+
+    /**
+     * @brief Diffusion discretization in 2D using central differences
+     *
+     * @param[in] data to be discretized
+     * @param[in] x index
+     * @param[in] y index
+     *
+     */
+    static double diffusion(const Matrix<double> &A, int i, int j) { return laplacian<false>(A, i, j, _stencil); }
+
+    /// Convection in x direction with the coefficients set by the constructor
+    static double convection_u(const Matrix<double> &U, const Matrix<double> &V, int i, int j) {
+        return convection_u<upwind_scheme::HYBRID, false>(U, V, i, j, _stencil);
+    }
+
+    /// Convection in y direction with the coefficients set by the constructor
+    static double convection_v(const Matrix<double> &U, const Matrix<double> &V, int i, int j) {
+        return convection_v<upwind_scheme::HYBRID, false>(U, V, i, j, _stencil);
+    }
+
+    /// Convection of temperature with the coefficients set by the constructor
+    static double convection_t(const Matrix<double> &T, const Matrix<double> &U, const Matrix<double> &V, int i,
+                               int j) {
+        return convection_t<upwind_scheme::HYBRID, false>(T, U, V, i, j, _stencil);
+    }
+
+    /// Laplacian with the coefficients set by the constructor
+    static double laplacian(const Matrix<double> &P, int i, int j) { return laplacian<false>(P, i, j, _stencil); }
+
+    /// SOR helper with the coefficients set by the constructor
+    static double sor_helper(const Matrix<double> &P, int i, int j) { return sor_helper<false>(P, i, j, _stencil); }
 
     /**
      * @brief Compute interpolated value in the middle between two grid points via linear interpolation.
@@ -117,10 +274,12 @@ class Discretization {
      * @param[out] result
      *
      */
-    static double interpolate(const Matrix<double> &A, int i, int j, int i_offset, int j_offset);
+    static double interpolate(const Matrix<double> &A, int i, int j, int i_offset, int j_offset) {
+        return 0.5 * (A(i, j) + A(i_offset, j_offset));
+    }
 
   private:
-    static double _dx;
-    static double _dy;
-    static double _gamma;
-};
\ No newline at end of file
+    inline static Stencil _stencil{};
+    upwind_scheme _scheme{upwind_scheme::HYBRID};
+    bool _uniform{false};
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include "Enums.hpp"
+#include <array>
 #include <mpi.h>
+#include <vector>
 
 /**
  * @brief Data structure that holds geometrical information
@@ -35,4 +37,9 @@ struct Domain {
 
     // MPI Addition to track the neighbours. Left is 0, right is 1, bottom is 2, top is 3
     std::array<int, 4> neighbour_ranks{-1, -1, -1, -1}; /*array to track neighbours*/
+
+    /// Cuts of the whole domain in x direction, process column I covers the interior columns x_cuts[I] + 1 to x_cuts[I + 1]
+    std::vector<int> x_cuts;
+    /// Cuts of the whole domain in y direction, process row J covers the interior rows y_cuts[J] + 1 to y_cuts[J + 1]
+    std::vector<int> y_cuts;
 };
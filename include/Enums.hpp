@@ -42,3 +42,35 @@ enum class cell_type {
     COLD_FIXED_WALL,
     ADIABATIC_FIXED_WALL
 };
+
+// Upwind blending of the convective terms, selected from gamma.
+// CENTRAL: gamma == 0, DONOR_CELL: gamma == 1, HYBRID: anything in between
+enum class upwind_scheme {
+    CENTRAL,
+    DONOR_CELL,
+    HYBRID,
+};
+
+// Instruction set of the explicitly vectorized row kernels, see SimdKernels.
+// SCALAR uses the per-cell kernels of Discretization.
+enum class simd_isa {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+// Time integration of the momentum and energy predictors, see Fields::set_time_integrator()
+enum class time_integrator {
+    EULER,
+    AB2,
+    SSP_RK3,
+};
+
+// Part of the interior cells of a subdomain. FRAME are the first and last row
+// and column, whose five point stencils read the halo, INNER all others.
+enum class subdomain_part {
+    ALL,
+    INNER,
+    FRAME,
+};
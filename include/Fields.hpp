@@ -1,8 +1,10 @@
 #pragma once
 
+#include "BoundaryTable.hpp"
 #include "Datastructures.hpp"
 #include "Discretization.hpp"
 #include "Grid.hpp"
+#include "SimdKernels.hpp"
 
 /**
  * @brief Class of container and modifier for the physical fields
@@ -55,6 +57,172 @@ class Fields {
      */
     void calculate_fluxes(Grid &grid);
 
+    /**
+     * @brief Fused calculate_fluxes() and calculate_rs() in a single sweep
+     *
+     * The right hand side is formed row by row right after the fluxes, while they
+     * are still in cache. Cells on the rim of the fluid region depend on boundary
+     * and halo fluxes that are only final afterwards; their right hand side has to
+     * be completed with calculate_rs_rim() once F and G are communicated.
+     *
+     * @param[in] grid in which the calculations are done
+     */
+    void calculate_fluxes_rs(Grid &grid);
+
+    /**
+     * @brief Recomputes the right hand side of the fluid cells next to boundary
+     * or ghost cells, completing calculate_fluxes_rs()
+     *
+     * @param[in] grid in which the calculations are done
+     */
+    void calculate_rs_rim(Grid &grid);
+
+    /**
+     * @brief Selects the flux and temperature kernels matching the given
+     * discretization, i.e. energy equation on/off, upwind scheme and uniform spacing
+     *
+     * Called once at Case construction, so that the time loop dispatches through a
+     * single function pointer instead of branching on the configuration per cell.
+     *
+     * @param[in] discretization used for the simulation
+     * @param[in] isa instruction set of the row kernels, SCALAR keeps the per-cell kernels
+     */
+    void select_kernels(const Discretization &discretization, simd_isa isa = simd_isa::SCALAR);
+
+    /**
+     * @brief Switches the diffusion terms to an implicit (backward Euler) treatment
+     *
+     * calculate_fluxes() and calculate_temperatures() then only compute the
+     * explicit convection, gravity and buoyancy part. The diffusion is solved
+     * afterwards by repeated diffuse_velocities() and diffuse_temperature() sweeps,
+     * and calculate_dt() drops the diffusive time step limits. Velocities and
+     * temperatures outside of the unknowns, i.e. on boundary faces and in ghost
+     * cells, are the values of the previous time step.
+     *
+     * @param[in] grid in which the calculations are done
+     * @param[in] implicit whether diffusion is treated implicitly
+     */
+    void set_implicit_diffusion(Grid &grid, bool implicit);
+
+    /**
+     * @brief Moves the fields onto another decomposition of the domain
+     *
+     * Every matrix in use is replaced by one of the new subdomain, with the
+     * values of its previous owners and filled ghost layers, see
+     * Communication::migrate(). The tables built from the grid are compiled
+     * again. Collective.
+     *
+     * @param[in] grid of the new subdomain
+     * @param[in] from domain the fields were distributed over so far
+     */
+    void redistribute(Grid &grid, const Domain &from);
+
+    /// whether diffusion is treated implicitly, see set_implicit_diffusion()
+    bool implicit_diffusion() const { return _implicit_diffusion; }
+
+    /**
+     * @brief Sets the largest x-velocity the moving walls and inlets drive the flow with
+     *
+     * With implicit diffusion calculate_dt() limits the timestep by this velocity as
+     * well, so that a flow starting from rest does not start with a huge timestep.
+     * The ghost cells are no measure for it, they hold up to twice the wall velocity.
+     *
+     * @param[in] velocity magnitude of the velocity imposed by the boundaries
+     */
+    void set_driving_velocity(double velocity) { _driving_velocity = velocity; }
+
+    /**
+     * @brief Selects the time integration of the momentum and energy predictors
+     *
+     * EULER is the forward Euler step. AB2 extrapolates the right hand sides of
+     * the current and the previous step (Adams-Bashforth 2, the first step is
+     * Euler). SSP_RK3 takes three Euler stages, each blended with the state at
+     * the beginning of the step (Shu-Osher form, so only that state is stored in
+     * addition), and projects every stage on its own. calculate_dt() scales the
+     * diffusive and convective limits by the stability region of the integrator.
+     * Only explicit diffusion is supported.
+     *
+     * @param[in] integrator time integration scheme
+     */
+    void set_time_integrator(time_integrator integrator);
+
+    /// number of stages, i.e. pressure projections, per timestep
+    int stages() const { return _integrator == time_integrator::SSP_RK3 ? 3 : 1; }
+
+    /**
+     * @brief Prepares the given stage of the current timestep, after the
+     * timestep size is set
+     *
+     * The stage k computes w_k * (X + dt * rhs(X)) + (1 - w_k) * X^n for the
+     * fluxes and temperatures, where X^n is the state stored by stage 0, and
+     * projects with the timestep w_k * dt.
+     *
+     * @param[in] stage index of the stage, starting at 0
+     */
+    void begin_stage(int stage);
+
+    /**
+     * @brief Lets the temperature take substeps of its own stable timestep
+     * within every timestep of the momentum equations
+     *
+     * calculate_dt() then leaves out the thermal diffusion limit and keeps it
+     * for temperature_dt() instead. The temperature is advanced after the
+     * momentum step by calculate_temperature_substep(). Only used with explicit
+     * diffusion and forward Euler.
+     *
+     * @param[in] subcycling whether the temperature is subcycled
+     */
+    void set_energy_subcycling(bool subcycling);
+
+    /// whether the temperature is subcycled, see set_energy_subcycling()
+    bool energy_subcycling() const { return _energy_subcycling; }
+
+    /// stable timestep of the temperature alone, set by calculate_dt() when subcycling
+    double temperature_dt() const { return _temperature_dt; }
+
+    /**
+     * @brief Stores the velocities at the beginning of the timestep, between
+     * which and the new ones the temperature substeps interpolate
+     */
+    void store_step_velocities();
+
+    /**
+     * @brief Substep k of n of the temperature with the timestep dt / n, after
+     * the momentum step
+     *
+     * The velocities of the substep are interpolated linearly in time between
+     * the ones stored by store_step_velocities() and the current ones, i.e. the
+     * substep starting at t + k / n dt sees (1 - k / n) u^n + k / n u^(n+1).
+     *
+     * @param[in] grid in which the calculations are done
+     * @param[in] substep index k of the substep, starting at 0
+     * @param[in] substeps number n of substeps
+     */
+    void calculate_temperature_substep(Grid &grid, int substep, int substeps);
+
+    /**
+     * @brief One Gauss-Seidel sweep for the implicit diffusion of F and G
+     *
+     * \f$F - dt \nu \nabla^2 F = F^*\f$, where \f$F^*\f$ is the explicit part
+     * computed by calculate_fluxes(), and the same for G. Only faces between two
+     * fluid cells are unknowns.
+     *
+     * @param[in] grid in which the calculations are done
+     * @return double local sum of the squared residuals before the sweep
+     */
+    double diffuse_velocities(Grid &grid);
+
+    /**
+     * @brief One Gauss-Seidel sweep for the implicit diffusion of the temperature
+     *
+     * \f$T - dt \alpha \nabla^2 T = T^*\f$, where \f$T^*\f$ is the explicit part
+     * computed by calculate_temperatures().
+     *
+     * @param[in] grid in which the calculations are done
+     * @return double local sum of the squared residuals before the sweep
+     */
+    double diffuse_temperature(Grid &grid);
+
     /**
      * @brief Right hand side calculations using the fluxes for the pressure
      * Poisson equation
@@ -70,12 +238,26 @@ class Fields {
      * @brief Velocity calculation using pressure values
      *
      * @param[in] grid in which the calculations are done
+     * @param[in] part cells to update, the INNER ones need no pressure halo
      *
      * \f$U_(i,j) = F_(i,j) - (dt/dx)*(P_(i+1,j)-P_(i,j))\f$
      * \f$V_(i,j) = G_(i,j) - (dt/dy)*(P_(i,j+1)-P_(i,j))\f$
      *
      */
-    void calculate_velocities(Grid &grid);
+    void calculate_velocities(Grid &grid, subdomain_part part = subdomain_part::ALL);
+
+    /**
+     * @brief Velocity calculation fused with the search for the maximal
+     * velocities, which the next calculate_dt() then reuses instead of sweeping
+     * the grid again
+     *
+     * The FRAME part of a split update combines its maxima with the ones of
+     * the INNER part, which must come first.
+     *
+     * @param[in] grid in which the calculations are done
+     * @param[in] part cells to update, the INNER ones need no pressure halo
+     */
+    void calculate_velocities_max(Grid &grid, subdomain_part part = subdomain_part::ALL);
 
     /**
      * @brief Temperature calculation using previous and velocities values
@@ -96,6 +278,32 @@ class Fields {
      */
     double calculate_dt(Grid &grid);
 
+    /**
+     * @brief Change of the fields since the previous call, for steady state detection
+     *
+     * Compares u, v, p and T of the fluid cells with the snapshot taken by the
+     * previous call and takes the new snapshot in the same sweep. The first call
+     * only takes the snapshot and reports an infinite change of magnitude 1.
+     * NaN values count as infinite, so that they survive the maxima.
+     *
+     * @param[in] grid in which the calculations are done
+     * @return std::array<double, 8> local maxima of |X - X_old| and |X| for X = u, v, p, T
+     */
+    std::array<double, 8> state_change(Grid &grid);
+
+    /**
+     * @brief Relative change of u, v, p and T per unit time
+     *
+     * The largest change of every field is divided by its largest magnitude, and
+     * the maximum over the fields is taken. A field that changed to zero
+     * everywhere counts as an infinite change.
+     *
+     * @param[in] change maxima of state_change(), reduced over all processes
+     * @param[in] dt timestep size of the last step
+     * @return double relative change per unit time, NaN once a field is no longer finite
+     */
+    static double state_change_rate(const std::array<double, 8> &change, double dt);
+
     /// x-velocity index based access and modify
     double &u(int i, int j);
 
@@ -120,6 +328,9 @@ class Fields {
     /// get timestep size
     double dt() const;
 
+    /// set timestep size, e.g. to the minimum over all processes
+    void set_dt(double dt);
+
     /// t matrix access and modify
     Matrix<double> &t_matrix();
 
@@ -142,9 +353,51 @@ class Fields {
     Matrix<double> &rs_matrix();
 
     /// getting energy equation status on or off
-    bool get_energy_eq() { return _energy_eq == "on"; };
+    bool get_energy_eq() const { return _energy_on; };
 
   private:
+    /// Kernel signature used for the configuration specific sweeps
+    using GridKernel = void (Fields::*)(Grid &);
+
+    /// Kernel signature for the cells [i_begin, i_end) of row j
+    using RowKernel = void (Fields::*)(int j, int i_begin, int i_end);
+
+    /// Interior flux computation of one row for one physics configuration
+    template <bool Energy, upwind_scheme Scheme, bool Uniform> void flux_kernel(int j, int i_begin, int i_end);
+
+    /// Interior temperature computation for one physics configuration
+    template <upwind_scheme Scheme, bool Uniform> void temperature_kernel(Grid &grid);
+
+    /// Assigns the kernel pointers for the given configuration
+    template <upwind_scheme Scheme, bool Uniform> void assign_kernels();
+
+    /// Interior flux computation of one row through the vectorized row kernel
+    void flux_kernel_rows(int j, int i_begin, int i_end);
+
+    /// Interior temperature computation through the vectorized row kernel
+    void temperature_kernel_rows(Grid &grid);
+
+    /// Coefficients of the row kernels for the current timestep
+    RowKernelParams row_kernel_params() const;
+
+    /// Applies the AB2 or Runge-Kutta combination to the fluxes of the cells [i_begin, i_end) of row j
+    void integrate_fluxes(int j, int i_begin, int i_end);
+
+    /// Applies the AB2 or Runge-Kutta combination to the new temperatures and stores them in T
+    void integrate_temperatures(Grid &grid);
+
+    /// timestep of the pressure projection of the running stage
+    double projection_dt() const { return _stage_weight * _dt; }
+
+    /// Right hand side of the PPE for the cells [i_begin, i_end) of row j
+    void rs_row(int j, int i_begin, int i_end, double inv_dx, double inv_dy, double inv_dt);
+
+    /// Flux values on the faces between fluid and boundary cells
+    void calculate_boundary_fluxes();
+
+    /// Builds the tables used by calculate_boundary_fluxes()
+    void compile_boundary_fluxes(Grid &grid);
+
     /// x-velocity matrix
     Matrix<double> _U;
     /// y-velocity matrix
@@ -161,10 +414,70 @@ class Fields {
     Matrix<double> _T;
     /// Newly calculated Temperature matrix
     Matrix<double> _T_new;
+    /// F from U and G from V on the faces between fluid and boundary cells
+    BoundaryTable _boundary_f;
+    BoundaryTable _boundary_g;
+    /// explicit parts of F and G while diffusion is solved implicitly
+    Matrix<double> _F_explicit;
+    Matrix<double> _G_explicit;
+    /// per cell: bit 0 if F(i, j), bit 1 if G(i, j) is an unknown of the implicit diffusion
+    std::vector<unsigned char> _diffusion_faces;
+    /// snapshot of the previous state_change() call
+    Matrix<double> _U_old;
+    Matrix<double> _V_old;
+    Matrix<double> _P_old;
+    Matrix<double> _T_old;
+    /// state at the beginning of the timestep, SSP_RK3 only
+    Matrix<double> _U_start;
+    Matrix<double> _V_start;
+    Matrix<double> _T_start;
+    /// right hand sides of the previous timestep, AB2 only
+    Matrix<double> _F_rate;
+    Matrix<double> _G_rate;
+    Matrix<double> _T_rate;
+    /// velocities at the beginning of the timestep and interpolated ones of the temperature substeps
+    Matrix<double> _U_step;
+    Matrix<double> _V_step;
+    Matrix<double> _U_substep;
+    Matrix<double> _V_substep;
+    /// temperature advanced in substeps of _temperature_dt, see set_energy_subcycling()
+    bool _energy_subcycling{false};
+    double _temperature_dt{0.0};
+    /// time integration of the predictors, see set_time_integrator()
+    time_integrator _integrator{time_integrator::EULER};
+    /// weight of the Euler step of the running stage, the rest goes to the state at the beginning of the step
+    double _stage_weight{1.0};
+    /// weight of the previous right hand side in the AB2 step, 0 in the first step
+    double _rate_weight{0.0};
+    /// timestep size the stored right hand sides belong to, 0 before the first step
+    double _rate_dt{0.0};
+    /// stability limits of the integrator relative to forward Euler
+    double _diffusive_dt_scale{1.0};
+    double _convective_dt_scale{1.0};
+    /// diffusion treated implicitly, see set_implicit_diffusion()
+    bool _implicit_diffusion{false};
+    /// x-velocity imposed by the boundaries, see set_driving_velocity()
+    double _driving_velocity{0.0};
     /// kinematic viscosity
     double _nu;
     // status if the energy_equations should be turned on or not
     std::string _energy_eq;
+    /// energy equation status evaluated once at construction
+    bool _energy_on{false};
+    /// selected interior flux kernel
+    RowKernel _flux_kernel{nullptr};
+    /// selected interior temperature kernel
+    GridKernel _temperature_kernel{nullptr};
+    /// vectorized row kernels, only set if a SIMD instruction set was selected
+    FluxRowKernel _flux_row{nullptr};
+    TemperatureRowKernel _temperature_row{nullptr};
+    /// row kernel coefficients of the running flux sweep
+    RowKernelParams _row_params;
+    /// maximum velocities found by calculate_velocities_max()
+    double _umax{0.001};
+    double _vmax{0.001};
+    /// whether _umax and _vmax belong to the current velocities
+    bool _velocity_max_valid{false};
     /// gravitional accelearation in x direction
     double _gx{0.0};
     /// gravitional accelearation in y direction
@@ -175,6 +488,9 @@ class Fields {
     double _tau;
     /// thermal diffusivity
     double _alpha;
+    /// viscosity and diffusivity of the explicit kernels, 0 with implicit diffusion
+    double _explicit_nu{0.0};
+    double _explicit_alpha{0.0};
     /// coefficient of thermal expansion
     double _beta;
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <map>
 #include <memory>
@@ -10,10 +11,49 @@
 #include "Datastructures.hpp"
 #include "Domain.hpp"
 #include "Enums.hpp"
+#include "Threading.hpp"
+
+/**
+ * @brief Contiguous run of interior fluid cells in row j, covering the
+ * half-open index range [i_begin, i_end)
+ *
+ */
+struct FluidSpan {
+    int j;
+    int i_begin;
+    int i_end;
+};
+
+/**
+ * @brief Block of consecutive rows [j_begin, j_end) with fluid cells, the unit
+ * of work of the thread-parallel loops
+ *
+ */
+struct FluidTile {
+    int j_begin;
+    int j_end;
+};
+
+/**
+ * @brief Layout of the compact per-cell metadata of the grid: the cell type in
+ * the low four bits, one flag per border with a fluid neighbour in the high four
+ * bits
+ */
+namespace cell_flags {
+const unsigned char type_mask = 0x0F;
+
+/// flag of the given border
+inline unsigned char border(border_position position) {
+    return static_cast<unsigned char>(0x10 << static_cast<int>(position));
+}
+} // namespace cell_flags
 
 /**
  * @brief Data structure holds cells and related sub-containers
  *
+ * Next to the Cell objects, which are used to set up the boundaries, the grid
+ * keeps one byte of type and border flags per cell (see cell_flags). All
+ * geometry checks of the time loop go through these flags.
  */
 class Grid {
   public:
@@ -31,8 +71,40 @@ class Grid {
      */
     Grid(std::string geom_name, Domain &domain, int process_rank = 0, int size = 1, int iproc = 1, int jproc = 1);
 
+    /**
+     * @brief Read the cell ids of a block of a pgm geometry file
+     *
+     * Text ("P2") and binary ("P5", one byte per id, two for a depth above
+     * 255) files are read. Only the lines of the block are kept, and of a
+     * binary file only the block itself is read.
+     *
+     * @param[in] filedoc pgm file name
+     * @param[in] domain whole domain the file has to match
+     * @param[in] imin first cell of the block in x direction, 0 is the left outer boundary
+     * @param[in] imax end of the block in x direction
+     * @param[in] jmin first cell of the block in y direction, 0 is the bottom outer boundary
+     * @param[in] jmax end of the block in y direction
+     * @return ids of the cells of the block, indexed [i - imin][j - jmin]
+     */
+    static std::vector<std::vector<int>> read_geometry(const std::string &filedoc, const Domain &domain, int imin,
+                                                       int imax, int jmin, int jmax);
+
     /// index based cell access
-    Cell cell(int i, int j) const;
+    const Cell &cell(int i, int j) const;
+
+    /// compact type and border flags of cell (i, j)
+    unsigned char flags(int i, int j) const { return _flags(i, j); }
+
+    /// type of cell (i, j)
+    cell_type type(int i, int j) const { return static_cast<cell_type>(_flags(i, j) & cell_flags::type_mask); }
+
+    /// whether cell (i, j) is a fluid cell
+    bool is_fluid(int i, int j) const { return type(i, j) == cell_type::FLUID; }
+
+    /// whether cell (i, j) has a fluid neighbour at the given border
+    bool is_border(int i, int j, border_position position) const {
+        return (_flags(i, j) & cell_flags::border(position)) != 0;
+    }
 
     /// access number of cells in x direction
     int imax() const;
@@ -58,6 +130,222 @@ class Grid {
      */
     const std::vector<Cell *> &fluid_cells() const;
 
+    /**
+     * @brief Access the interior fluid cells as row-wise contiguous spans
+     *
+     * Ghost layers are excluded, so kernels can loop over the spans without
+     * any per-cell index checks.
+     *
+     * @param[out] vector of fluid spans ordered by row, then by column
+     */
+    const std::vector<FluidSpan> &fluid_spans() const;
+
+    /// whether every interior cell of the subdomain is a fluid cell
+    bool dense() const;
+
+    /**
+     * @brief Access the fluid cells with a non-fluid or ghost cell among their
+     * four neighbours
+     *
+     * @param[out] vector of fluid rim cells
+     */
+    const std::vector<Cell *> &fluid_rim_cells() const;
+
+    /**
+     * @brief Calls kernel(j, i_begin, i_end) for every row-wise run of interior
+     * fluid cells, in the same order as fluid_cells()
+     *
+     * Subdomains without obstacles take a dense path over full rows, others
+     * iterate the precomputed fluid spans.
+     *
+     * @param[in] kernel callable taking the row index and the half-open column range
+     */
+    template <typename Kernel> void for_each_fluid_span(Kernel &&kernel) const {
+        for_each_fluid_span_in_rows(1, _domain.size_y + 1, kernel);
+    }
+
+    /**
+     * @brief for_each_fluid_span() restricted to the rows [j_begin, j_end)
+     *
+     * @param[in] j_begin first row
+     * @param[in] j_end row after the last one
+     * @param[in] kernel callable taking the row index and the half-open column range
+     */
+    template <typename Kernel> void for_each_fluid_span_in_rows(int j_begin, int j_end, Kernel &&kernel) const {
+        if (_dense) {
+            for (int j = j_begin; j < j_end; ++j) {
+                kernel(j, 1, _domain.size_x + 1);
+            }
+        } else {
+            for (int k = _row_spans[j_begin]; k < _row_spans[j_end]; ++k) {
+                const auto &span = _fluid_spans[k];
+                kernel(span.j, span.i_begin, span.i_end);
+            }
+        }
+    }
+
+    /**
+     * @brief Access the fluid tiles, ordered by row
+     *
+     * The tiles hold roughly the same number of fluid cells, rows without fluid
+     * cells belong to no tile.
+     *
+     * @param[out] vector of fluid tiles
+     */
+    const std::vector<FluidTile> &fluid_tiles() const;
+
+    /**
+     * @brief Calls task(j_begin, j_end) for every fluid tile with the threads of
+     * a new parallel region
+     *
+     * The tiles are handed out by work stealing (see Threading::for_each_task()),
+     * so threads that got cheap tiles help out the others.
+     *
+     * @param[in] task callable taking the half-open row range of the tile
+     */
+    template <typename Task> void parallel_for_each_fluid_tile(Task &&task) const {
+        Threading::for_each_task(static_cast<int>(_fluid_tiles.size()),
+                                 [&](int k) { task(_fluid_tiles[k].j_begin, _fluid_tiles[k].j_end); });
+    }
+
+    /**
+     * @brief Thread-parallel for_each_fluid_span()
+     *
+     * The rows are processed tile by tile (see parallel_for_each_fluid_tile()), so
+     * kernels must only write to cells of the row they are called for.
+     *
+     * @param[in] kernel callable taking the row index and the half-open column range
+     */
+    template <typename Kernel> void parallel_for_each_fluid_span(Kernel &&kernel) const {
+        parallel_for_each_fluid_tile(
+            [&](int j_begin, int j_end) { for_each_fluid_span_in_rows(j_begin, j_end, kernel); });
+    }
+
+    /**
+     * @brief parallel_for_each_fluid_span() restricted to a part of the subdomain
+     *
+     * The INNER cells need no halo values, so they can be updated while the
+     * halo exchange is in flight and the FRAME cells after it has finished.
+     *
+     * @param[in] part cells to visit
+     * @param[in] kernel callable taking the row index and the half-open column range
+     */
+    template <typename Kernel> void parallel_for_each_fluid_span(subdomain_part part, Kernel &&kernel) const {
+        parallel_for_each_fluid_span(
+            [&](int j, int i_begin, int i_end) { for_each_part_of_span(part, j, i_begin, i_end, kernel); });
+    }
+
+    /**
+     * @brief Calls kernel(j, i_begin, i_end) for the runs of cells of the span in
+     * row j from i_begin to i_end that belong to the given part of the subdomain
+     */
+    template <typename Kernel>
+    void for_each_part_of_span(subdomain_part part, int j, int i_begin, int i_end, Kernel &&kernel) const {
+        if (part == subdomain_part::ALL) {
+            kernel(j, i_begin, i_end);
+            return;
+        }
+        const bool frame_row = j == 1 || j == _domain.size_y;
+        const int inner_begin = std::max(i_begin, 2);
+        const int inner_end = std::min(i_end, _domain.size_x);
+        if (part == subdomain_part::INNER) {
+            if (!frame_row && inner_begin < inner_end) {
+                kernel(j, inner_begin, inner_end);
+            }
+            return;
+        }
+        if (frame_row || inner_begin >= inner_end) {
+            kernel(j, i_begin, i_end);
+            return;
+        }
+        if (i_begin < inner_begin) {
+            kernel(j, i_begin, inner_begin);
+        }
+        if (inner_end < i_end) {
+            kernel(j, inner_end, i_end);
+        }
+    }
+
+    /**
+     * @brief Applies update(i, j) in place to every interior fluid cell in
+     * lexicographic order, e.g. for Gauss-Seidel type sweeps
+     *
+     * With more than one thread the subdomain is cut into tiles that are
+     * processed as a wavefront along the anti-diagonals. A cell only depends on
+     * its left and lower neighbours, which lie in the same tile or in a tile of an
+     * earlier diagonal, so the result is identical to the serial sweep for any
+     * number of threads.
+     *
+     * @param[in] update callable taking the cell indices
+     */
+    template <typename Update> void ordered_for_each_fluid_cell(Update &&update) const {
+        const int threads = Threading::num_threads();
+        if (threads == 1) {
+            for_each_fluid_span([&](int j, int i_begin, int i_end) {
+                for (int i = i_begin; i < i_end; ++i) {
+                    update(i, j);
+                }
+            });
+            return;
+        }
+
+        const int nx = _domain.size_x;
+        const int ny = _domain.size_y;
+        const int tiles_x = std::max(1, std::min(2 * threads, nx / 8));
+        const int tiles_y = std::max(1, std::min(2 * threads, ny / 4));
+
+#pragma omp parallel
+        for (int diagonal = 0; diagonal < tiles_x + tiles_y - 1; ++diagonal) {
+            const int tx_first = std::max(0, diagonal - tiles_y + 1);
+            const int tx_last = std::min(diagonal, tiles_x - 1);
+#pragma omp for schedule(static)
+            for (int tx = tx_first; tx <= tx_last; ++tx) {
+                const int ty = diagonal - tx;
+                const int i_lo = 1 + tx * nx / tiles_x;
+                const int i_hi = 1 + (tx + 1) * nx / tiles_x;
+                for_each_fluid_span_in_rows(
+                    1 + ty * ny / tiles_y, 1 + (ty + 1) * ny / tiles_y, [&](int j, int i_begin, int i_end) {
+                        for (int i = std::max(i_begin, i_lo); i < std::min(i_end, i_hi); ++i) {
+                            update(i, j);
+                        }
+                    });
+            }
+        }
+    }
+
+    /**
+     * @brief Thread-parallel reduction over the fluid spans
+     *
+     * The partial results of every row are combined in row order afterwards, so
+     * the result does not depend on the number of threads. Every reduction starts
+     * from 0.
+     *
+     * @param[in] kernel callable taking the row index and the half-open column
+     * range, returning the std::array<double, N> partial results of the span
+     * @param[in] combine associative binary operation, e.g. sum or maximum
+     * @param[in] part cells to reduce over, see parallel_for_each_fluid_span()
+     * @param[out] the N reduced values
+     */
+    template <std::size_t N, typename Kernel, typename Combine>
+    std::array<double, N> reduce_fluid_spans(Kernel &&kernel, Combine &&combine,
+                                             subdomain_part part = subdomain_part::ALL) const {
+        std::vector<std::array<double, N>> rows(_domain.size_y + 2, std::array<double, N>{});
+        parallel_for_each_fluid_span(part, [&](int j, int i_begin, int i_end) {
+            const std::array<double, N> partial = kernel(j, i_begin, i_end);
+            for (std::size_t n = 0; n < N; ++n) {
+                rows[j][n] = combine(rows[j][n], partial[n]);
+            }
+        });
+
+        std::array<double, N> result{};
+        for (const auto &row : rows) {
+            for (std::size_t n = 0; n < N; ++n) {
+                result[n] = combine(result[n], row[n]);
+            }
+        }
+        return result;
+    }
+
     /**
      * @brief Access moving wall cells
      *
@@ -86,6 +374,14 @@ class Grid {
      */
     const std::vector<Cell *> &outflow_cells() const;
 
+    /**
+     * @brief Access convective outflow cells, i.e. outflow cells of the id
+     * marked "Outflow (convective)" in the legend of the geometry file
+     *
+     * @param[out] vector of convective outflow cells
+     */
+    const std::vector<Cell *> &convective_outflow_cells() const;
+
     /**
      * @brief Access hot fixed wall cells
      *
@@ -148,21 +444,37 @@ class Grid {
     void assign_cell_types(std::vector<std::vector<int>> &geometry_data, std::string geom_name);
     // Build cell data structures with given geometrical data for PlaneShearFlow
     void assign_cell_types_planeshearflow(std::vector<std::vector<int>> &geometry_data);
+    /// Pack type and borders of every cell into _flags
+    void build_cell_flags();
+    /// Collect the row-wise runs of interior fluid cells and the fluid rim cells
+    void build_fluid_spans();
+    /// Cut the rows with fluid cells into tiles of similar fluid cell count
+    void build_fluid_tiles();
     /// Extract geometry from pgm file and create geometrical data
     void parse_geometry_file(std::string filedoc, std::vector<std::vector<int>> &geometry_data);
 
     Matrix<Cell> _cells;
+    /// one byte of type and border flags per cell, see cell_flags
+    Matrix<unsigned char> _flags;
     std::vector<Cell *> _fluid_cells;
     std::vector<Cell *> _fixed_wall_cells;
     std::vector<Cell *> _moving_wall_cells;
     std::vector<Cell *> _inflow_cells;
     std::vector<Cell *> _outflow_cells;
+    std::vector<Cell *> _convective_outflow_cells;
     std::vector<Cell *> _hot_fixed_wall_cells;
     std::vector<Cell *> _cold_fixed_wall_cells;
     std::vector<Cell *> _adiabatic_fixed_wall_cells;
+    std::vector<FluidSpan> _fluid_spans;
+    /// spans of row j are _fluid_spans[_row_spans[j]] up to _fluid_spans[_row_spans[j + 1]]
+    std::vector<int> _row_spans;
+    std::vector<Cell *> _fluid_rim_cells;
+    std::vector<FluidTile> _fluid_tiles;
+    bool _dense{false};
 
     int inflow_wall_id;
     int outflow_wall_id;
+    int convective_outflow_wall_id{-1};
     int fixed_wall_id;
     int hot_fixed_wall_id;
     int cold_fixed_wall_id;
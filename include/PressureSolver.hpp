@@ -1,10 +1,93 @@
 #pragma once
 
 #include "Boundary.hpp"
+#include "Communication.hpp"
 #include "Discretization.hpp"
 #include "Fields.hpp"
 #include "Grid.hpp"
+#include "Threading.hpp"
+#include <algorithm>
+#include <array>
 #include <utility>
+
+/**
+ * @brief Five point PPE stencil of one fluid cell with the pressure boundary
+ * conditions substituted, i.e.
+ * laplacian = east * p(i+1, j) + west * p(i-1, j) + north * p(i, j+1) + south * p(i, j-1) + constant - diagonal * p(i, j)
+ */
+struct PressureStencil {
+    double east{0.0};
+    double west{0.0};
+    double north{0.0};
+    double south{0.0};
+    double constant{0.0};
+    double diagonal{0.0};
+    /// 1 / diagonal, 0 for a cell without any coupling
+    double inv_diagonal{0.0};
+};
+
+/**
+ * @brief Matrix-free PPE operator with the pressure boundary conditions folded
+ * into the stencil coefficients
+ *
+ * Built once from the cell types of the grid. A neighbour of a fluid cell is
+ * either fluid, a boundary with zero pressure gradient (walls and inflow,
+ * p_ghost = p) or an outflow with fixed pressure (p_ghost = 2 p_out - p). With the
+ * ghost values substituted, the solvers never read the ghost cells, so the
+ * boundaries do not have to be applied between the iterations.
+ *
+ * Every cell stores one byte, two bits per neighbour, which selects one of the
+ * 256 possible stencils.
+ */
+class PressureOperator {
+  public:
+    PressureOperator() = default;
+
+    /**
+     * @brief Builds the operator for the fluid cells of the grid
+     *
+     * @param[in] grid to be used
+     * @param[in] outlet_pressure fixed pressure of the outflow boundaries
+     */
+    PressureOperator(const Grid &grid, double outlet_pressure);
+
+    /// stencil of cell (i, j)
+    const PressureStencil &stencil(int i, int j) const { return _stencils[_kind[_stride * j + i]]; }
+
+    /// index of the stencil of cell (i, j), two bits per neighbour
+    unsigned char kind(int i, int j) const { return _kind[_stride * j + i]; }
+
+    /// stencil of the given kind
+    const PressureStencil &stencil_of_kind(unsigned char kind) const { return _stencils[kind]; }
+
+    /// laplacian of p at the fluid cell (i, j), including the boundary contributions
+    double laplacian(const Matrix<double> &p, int i, int j) const {
+        const PressureStencil &s = stencil(i, j);
+        return s.east * p(i + 1, j) + s.west * p(i - 1, j) + s.north * p(i, j + 1) + s.south * p(i, j - 1) +
+               s.constant - s.diagonal * p(i, j);
+    }
+
+    /// linear part of laplacian(), i.e. without the outlet pressure, as needed for Krylov directions
+    double apply_linear(const Matrix<double> &d, int i, int j) const {
+        const PressureStencil &s = stencil(i, j);
+        return s.east * d(i + 1, j) + s.west * d(i - 1, j) + s.north * d(i, j + 1) + s.south * d(i, j - 1) -
+               s.diagonal * d(i, j);
+    }
+
+    /// p(i, j) that zeroes the residual of cell (i, j) with the neighbours of p fixed
+    double relaxed(const Matrix<double> &p, const Matrix<double> &rs, int i, int j) const {
+        const PressureStencil &s = stencil(i, j);
+        return s.inv_diagonal * (s.east * p(i + 1, j) + s.west * p(i - 1, j) + s.north * p(i, j + 1) +
+                                 s.south * p(i, j - 1) + s.constant - rs(i, j));
+    }
+
+  private:
+    int _stride{0};
+    /// per cell: two bits per neighbour (east, west, north, south), 0 boundary, 1 fluid, 2 outflow
+    std::vector<unsigned char> _kind;
+    std::array<PressureStencil, 256> _stencils;
+};
+
 /**
  * @brief Abstract class for pressure Poisson equation solver
  *
@@ -22,6 +105,41 @@ class PressureSolver {
      * @param[in] boundary to be used
      */
     virtual double solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<Boundary>> &boundaries) = 0;
+
+    /**
+     * @brief Folds the pressure boundary conditions into the stencil, after which
+     * the solver does not need the boundaries applied between the iterations
+     *
+     * @param[in] grid to be used
+     * @param[in] outlet_pressure fixed pressure of the outflow boundaries
+     */
+    void fold_boundaries(const Grid &grid, double outlet_pressure);
+
+    /// whether the pressure boundary conditions are part of the stencil
+    bool folded() const { return _folded; }
+
+    /// called before the iterations on a new right hand side, i.e. once per timestep or Runge-Kutta stage
+    virtual void start_solve() {}
+
+    /// number of sweeps over the grid done by one solve()
+    virtual int sweeps() const { return 1; }
+
+    /// whether solve() exchanges the pressure halos itself, leaving the ghost layer of the subdomain stale
+    virtual bool exchanges_halos() const { return false; }
+
+  protected:
+    /**
+     * @brief Sum of the squared PPE residuals over the interior fluid cells
+     *
+     * @param[in] field holding pressure and right hand side
+     * @param[in] grid to be used
+     * @return double the local squared residual sum
+     */
+    double squared_residual(Fields &field, const Grid &grid) const;
+
+    /// stencils with the boundary conditions, only set up if _folded
+    PressureOperator _operator;
+    bool _folded{false};
 };
 
 class StationarySolver : public PressureSolver {
@@ -115,6 +233,78 @@ class WeightedJacobi : public StationarySolver {
     double _omega;
 };
 
+/**
+ * @brief Jacobi or weighted Jacobi iterations on a copy of the pressure with
+ * ghost layers of width depth, so that depth sweeps share one halo exchange
+ *
+ * The first sweep after an exchange also updates the depth - 1 innermost
+ * ghost layers, every further sweep one layer less. The ghost cells are thus
+ * computed by both neighbours, and after depth sweeps the own cells are the
+ * same as with an exchange after every sweep. The stencil kinds of the ghost
+ * cells come from the neighbours once, so the pressure boundaries have to be
+ * folded into the stencil (see PressureOperator).
+ */
+class DeepHaloJacobi : public StationarySolver {
+  public:
+    DeepHaloJacobi() = default;
+
+    /**
+     * @brief Constructor of the deep halo Jacobi solver
+     *
+     * @param[in] depth number of ghost layers and sweeps per exchange
+     */
+    DeepHaloJacobi(int depth);
+
+    /**
+     * @brief Constructor of the deep halo weighted Jacobi solver
+     *
+     * @param[in] depth number of ghost layers and sweeps per exchange
+     * @param[in] omega relaxation factor
+     */
+    DeepHaloJacobi(int depth, double omega);
+
+    virtual ~DeepHaloJacobi() = default;
+
+    /**
+     * @brief Exchanges the halos and does depth sweeps
+     *
+     * @param[in] field to be used
+     * @param[in] grid to be used
+     * @param[in] boundary to be used
+     * @return double the squared residual sum of the own cells before the last sweep
+     */
+    virtual double solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<Boundary>> &boundaries);
+
+    /// the right hand side is copied and exchanged again on the next solve()
+    virtual void start_solve() { _new_rhs = true; }
+
+    virtual int sweeps() const { return _depth; }
+
+    virtual bool exchanges_halos() const { return true; }
+
+  private:
+    /// sets up the deep matrices, their halo exchanges and the fluid spans of the deep rows
+    void setup(const Grid &grid);
+
+    int _depth{1};
+    double _omega{1.0};
+    bool _weighted{false};
+    bool _new_rhs{true};
+
+    /// pressure, its next iterate and right hand side, field cell (i, j) is at (i + depth - 1, j + depth - 1)
+    Matrix<double> _p;
+    Matrix<double> _p_next;
+    Matrix<double> _rs;
+    /// PressureOperator::kind() of every fluid cell, -1 for the other cells
+    Matrix<double> _kinds;
+    /// fluid spans of all deep rows, those of row j start at _row_spans[j]
+    std::vector<FluidSpan> _spans;
+    std::vector<int> _row_spans;
+
+    HaloExchange _p_halo;
+    HaloExchange _rs_halo;
+};
+
 /**
  * @brief Gauss Seidel iteration to solve the Pressure Poisson Equation
  *
@@ -198,6 +388,9 @@ class ConjugateGradient : public GradientMethods {
     ConjugateGradient(Fields &field);
 
     virtual ~ConjugateGradient() = default;
+
+    /// the search directions restart for every new right hand side, i.e. every timestep or stage
+    virtual void start_solve();
     /**
      * @brief Solver the pressure equation on given field using Conjugate Gradient iterations
      *
@@ -220,9 +413,10 @@ class MultiGrid : public PressureSolver {
      * @param max_multi_grid_level maximum level for multigrid method
      * @param smoothing_pre_recur number of smoothing iterations before the multigrid step
      * @param smoothing_post_recur number of smoothing iterations after the multigrid step
+     * @param block_sweeps number of smoothing iterations done per pass over the grid
      */
 
-    MultiGrid(int max_multi_grid_level, int smoothing_pre_recur, int smoothing_post_recur);
+    MultiGrid(int max_multi_grid_level, int smoothing_pre_recur, int smoothing_post_recur, int block_sweeps = 4);
 
     virtual ~MultiGrid() = default;
     /**
@@ -237,6 +431,8 @@ class MultiGrid : public PressureSolver {
 
   protected:
     int _smoothing_pre_recur, _smoothing_post_recur, _max_multi_grid_level;
+    /// Jacobi sweeps of the smoother applied per pass over the grid (temporal blocking)
+    int _block_sweeps{4};
     /**
      * @brief Recursive call for the Multigrid scheme
      *
@@ -262,6 +458,22 @@ class MultiGrid : public PressureSolver {
      * @return Matrix<double> smoothed error matrix
      */
     Matrix<double> smoother(Matrix<double> error, Matrix<double> residual, int iter, double dx, double dy);
+    /**
+     * @brief Applies several smoother sweeps in a single pass over the grid
+     *
+     * Gives the same result as running the sweeps one after another, including
+     * the Neumann boundary values of the left and right ghost columns. The top and
+     * bottom ghost rows of out are left to the caller.
+     *
+     * @param in error matrix before the sweeps
+     * @param out error matrix after the sweeps
+     * @param rs residual matrix used for smoothing
+     * @param sweeps number of Jacobi sweeps
+     * @param dx x-stepsize of the problem
+     * @param dy y-stepsize of the problem
+     */
+    void blocked_jacobi_pass(const Matrix<double> &in, Matrix<double> &out, const Matrix<double> &rs, int sweeps,
+                             double dx, double dy);
     /**
      * @brief Method to calculate the residual based on the laplacian operator
      *
@@ -339,9 +551,11 @@ class MultiGridVCycle : public MultiGrid {
      * @param max_multi_grid_level maximum level for multigrid method
      * @param smoothing_pre_recur number of smoothing iterations before the multigrid step
      * @param smoothing_post_recur number of smoothing iteratoins after the multigrid step
+     * @param block_sweeps number of smoothing iterations done per pass over the grid
      */
 
-    MultiGridVCycle(int max_multi_grid_level, int smoothing_pre_recur, int smoothing_post_recur);
+    MultiGridVCycle(int max_multi_grid_level, int smoothing_pre_recur, int smoothing_post_recur,
+                    int block_sweeps = 4);
 
     virtual ~MultiGridVCycle() = default;
     /**
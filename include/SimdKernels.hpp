@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+
+#include "Enums.hpp"
+
+/**
+ * @brief Coefficients used by the row-wise flux and temperature kernels
+ *
+ */
+struct RowKernelParams {
+    double dt{0.0};
+    double nu{0.0};
+    double alpha{0.0};
+    double beta{0.0};
+    double gamma{0.0};
+    double gx{0.0};
+    double gy{0.0};
+    double inv_dx{1.0};
+    double inv_dy{1.0};
+    double inv_dx2{1.0};
+    double inv_dy2{1.0};
+};
+
+/**
+ * @brief Computes F and G for the cells [i_begin, i_end) of one row.
+ *
+ * All field pointers address element i = 0 of the row, the rows below and above
+ * are reached through -stride and +stride. t is only read if the kernel was
+ * selected with the energy equation turned on.
+ */
+using FluxRowKernel = void (*)(const double *u, const double *v, const double *t, double *f, double *g, int stride,
+                               int i_begin, int i_end, const RowKernelParams &params);
+
+/**
+ * @brief Computes the new temperature for the cells [i_begin, i_end) of one row.
+ *
+ * Pointer conventions as for FluxRowKernel.
+ */
+using TemperatureRowKernel = void (*)(const double *t, const double *u, const double *v, double *t_new, int stride,
+                                      int i_begin, int i_end, const RowKernelParams &params);
+
+/**
+ * @brief Explicitly vectorized row kernels for the momentum fluxes and the
+ * temperature advection-diffusion.
+ *
+ * Every instruction set lives in its own translation unit, compiled with the
+ * matching compiler flags (see CMakeLists.txt). The instruction set is chosen at
+ * runtime from what the CPU reports, so one binary runs on all x86-64 nodes. The
+ * scalar reference are the per-cell kernels in Discretization, selected with
+ * simd_isa::SCALAR.
+ */
+class SimdKernels {
+  public:
+    /**
+     * @brief Best instruction set supported by both the CPU and the build
+     *
+     * @return simd_isa the detected instruction set
+     */
+    static simd_isa detect();
+
+    /**
+     * @brief Instruction set for a user request
+     *
+     * @param request one of "auto", "scalar", "sse2", "avx2", "avx512"
+     * @return simd_isa the requested instruction set if available, otherwise the detected one
+     */
+    static simd_isa select(const std::string &request);
+
+    /**
+     * @brief Whether kernels for the given instruction set can run here
+     *
+     * @param isa instruction set to check
+     */
+    static bool available(simd_isa isa);
+
+    /**
+     * @brief Row kernel for F and G
+     *
+     * @param isa instruction set, must be available
+     * @param energy whether the Boussinesq term is used instead of plain gravity
+     * @return FluxRowKernel kernel, nullptr for simd_isa::SCALAR
+     */
+    static FluxRowKernel flux_row(simd_isa isa, bool energy);
+
+    /**
+     * @brief Row kernel for the temperature update
+     *
+     * @param isa instruction set, must be available
+     * @return TemperatureRowKernel kernel, nullptr for simd_isa::SCALAR
+     */
+    static TemperatureRowKernel temperature_row(simd_isa isa);
+
+    /// printable name of an instruction set
+    static std::string name(simd_isa isa);
+};
+
+// Entry points of the instruction set specific translation units. They return
+// nullptr if the compiler could not target the instruction set.
+FluxRowKernel flux_row_sse2(bool energy);
+FluxRowKernel flux_row_avx2(bool energy);
+FluxRowKernel flux_row_avx512(bool energy);
+TemperatureRowKernel temperature_row_sse2();
+TemperatureRowKernel temperature_row_avx2();
+TemperatureRowKernel temperature_row_avx512();
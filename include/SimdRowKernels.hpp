@@ -0,0 +1,179 @@
+#pragma once
+
+// Shared body of the row kernels. Only included by the instruction set specific
+// translation units (src/SimdKernels*.cpp), each of which instantiates it with its
+// own lane type. Everything lives in an anonymous namespace, so that code built
+// with different target flags is never merged by the linker.
+//
+// A lane type provides the vector register type `type`, the number of doubles per
+// register `width` and static load/store/set1/add/sub/mul/abs functions.
+
+#include "SimdKernels.hpp"
+
+namespace {
+
+/// One double at a time, used for the remainder of a row
+struct ScalarLane {
+    using type = double;
+    static constexpr int width = 1;
+    static type load(const double *p) { return *p; }
+    static void store(double *p, type a) { *p = a; }
+    static type set1(double a) { return a; }
+    static type add(type a, type b) { return a + b; }
+    static type sub(type a, type b) { return a - b; }
+    static type mul(type a, type b) { return a * b; }
+    static type abs(type a) { return a < 0.0 ? -a : a; }
+};
+
+/// F and G for the Lane::width cells starting at column i
+template <class Lane, bool Energy>
+inline void flux_cells(const double *u, const double *v, const double *t, double *f, double *g, int stride, int i,
+                       const RowKernelParams &p) {
+    using L = Lane;
+    using R = typename Lane::type;
+
+    const double *u_s = u - stride;
+    const double *u_n = u + stride;
+    const double *v_s = v - stride;
+    const double *v_n = v + stride;
+
+    const R gamma = L::set1(p.gamma);
+    const R quarter = L::set1(0.25);
+    const R two = L::set1(2.0);
+    const R inv_dx = L::set1(p.inv_dx);
+    const R inv_dy = L::set1(p.inv_dy);
+    const R inv_dx2 = L::set1(p.inv_dx2);
+    const R inv_dy2 = L::set1(p.inv_dy2);
+    const R dt = L::set1(p.dt);
+    const R nu = L::set1(p.nu);
+
+    const R uc = L::load(u + i);
+    const R ue = L::load(u + i + 1);
+    const R uw = L::load(u + i - 1);
+    const R un = L::load(u_n + i);
+    const R us = L::load(u_s + i);
+    const R unw = L::load(u_n + i - 1);
+    const R vc = L::load(v + i);
+    const R ve = L::load(v + i + 1);
+    const R vw = L::load(v + i - 1);
+    const R vn = L::load(v_n + i);
+    const R vs = L::load(v_s + i);
+    const R vse = L::load(v_s + i + 1);
+
+    // x-momentum: d(u^2)/dx + d(uv)/dy with donor-cell blending
+    R face_e = L::add(uc, ue);
+    R face_w = L::add(uw, uc);
+    R face_n = L::add(vc, ve);
+    R face_s = L::add(vs, vse);
+
+    R du2dx = L::sub(L::mul(face_e, face_e), L::mul(face_w, face_w));
+    R up = L::sub(L::mul(L::abs(face_e), L::sub(uc, ue)), L::mul(L::abs(face_w), L::sub(uw, uc)));
+    du2dx = L::add(du2dx, L::mul(gamma, up));
+
+    R duvdy = L::sub(L::mul(face_n, L::add(uc, un)), L::mul(face_s, L::add(us, uc)));
+    up = L::sub(L::mul(L::abs(face_n), L::sub(uc, un)), L::mul(L::abs(face_s), L::sub(us, uc)));
+    duvdy = L::add(duvdy, L::mul(gamma, up));
+
+    R conv = L::mul(quarter, L::add(L::mul(inv_dx, du2dx), L::mul(inv_dy, duvdy)));
+    R lap = L::add(L::mul(L::sub(L::add(ue, uw), L::mul(two, uc)), inv_dx2),
+                   L::mul(L::sub(L::add(un, us), L::mul(two, uc)), inv_dy2));
+    R rhs = L::sub(L::mul(nu, lap), conv);
+
+    if constexpr (Energy) {
+        const R buoyancy = L::set1(0.5 * p.dt * p.beta * p.gx);
+        R t_face = L::add(L::load(t + i), L::load(t + i + 1));
+        L::store(f + i, L::sub(L::add(uc, L::mul(dt, rhs)), L::mul(buoyancy, t_face)));
+    } else {
+        L::store(f + i, L::add(uc, L::mul(dt, L::add(rhs, L::set1(p.gx)))));
+    }
+
+    // y-momentum: d(uv)/dx + d(v^2)/dy with donor-cell blending
+    face_e = L::add(uc, un);
+    face_w = L::add(uw, unw);
+    face_n = L::add(vc, vn);
+    face_s = L::add(vs, vc);
+
+    R duvdx = L::sub(L::mul(face_e, L::add(vc, ve)), L::mul(face_w, L::add(vw, vc)));
+    up = L::sub(L::mul(L::abs(face_e), L::sub(vc, ve)), L::mul(L::abs(face_w), L::sub(vw, vc)));
+    duvdx = L::add(duvdx, L::mul(gamma, up));
+
+    R dv2dy = L::sub(L::mul(face_n, face_n), L::mul(face_s, face_s));
+    up = L::sub(L::mul(L::abs(face_n), L::sub(vc, vn)), L::mul(L::abs(face_s), L::sub(vs, vc)));
+    dv2dy = L::add(dv2dy, L::mul(gamma, up));
+
+    conv = L::mul(quarter, L::add(L::mul(inv_dx, duvdx), L::mul(inv_dy, dv2dy)));
+    lap = L::add(L::mul(L::sub(L::add(ve, vw), L::mul(two, vc)), inv_dx2),
+                 L::mul(L::sub(L::add(vn, vs), L::mul(two, vc)), inv_dy2));
+    rhs = L::sub(L::mul(nu, lap), conv);
+
+    if constexpr (Energy) {
+        const R buoyancy = L::set1(0.5 * p.dt * p.beta * p.gy);
+        R t_face = L::add(L::load(t + i), L::load(t + stride + i));
+        L::store(g + i, L::sub(L::add(vc, L::mul(dt, rhs)), L::mul(buoyancy, t_face)));
+    } else {
+        L::store(g + i, L::add(vc, L::mul(dt, L::add(rhs, L::set1(p.gy)))));
+    }
+}
+
+/// New temperature for the Lane::width cells starting at column i
+template <class Lane>
+inline void temperature_cells(const double *t, const double *u, const double *v, double *t_new, int stride, int i,
+                              const RowKernelParams &p) {
+    using L = Lane;
+    using R = typename Lane::type;
+
+    const R gamma = L::set1(p.gamma);
+    const R half = L::set1(0.5);
+    const R two = L::set1(2.0);
+
+    const R tc = L::load(t + i);
+    const R te = L::load(t + i + 1);
+    const R tw = L::load(t + i - 1);
+    const R tn = L::load(t + stride + i);
+    const R ts = L::load(t - stride + i);
+    const R uc = L::load(u + i);
+    const R uw = L::load(u + i - 1);
+    const R vc = L::load(v + i);
+    const R vs = L::load(v - stride + i);
+
+    R dutdx = L::sub(L::mul(L::add(tc, te), uc), L::mul(L::add(tw, tc), uw));
+    R up = L::sub(L::mul(L::abs(uc), L::sub(tc, te)), L::mul(L::abs(uw), L::sub(tw, tc)));
+    dutdx = L::add(dutdx, L::mul(gamma, up));
+
+    R dvtdy = L::sub(L::mul(L::add(tc, tn), vc), L::mul(L::add(ts, tc), vs));
+    up = L::sub(L::mul(L::abs(vc), L::sub(tc, tn)), L::mul(L::abs(vs), L::sub(ts, tc)));
+    dvtdy = L::add(dvtdy, L::mul(gamma, up));
+
+    R conv = L::mul(half, L::add(L::mul(L::set1(p.inv_dx), dutdx), L::mul(L::set1(p.inv_dy), dvtdy)));
+    R lap = L::add(L::mul(L::sub(L::add(te, tw), L::mul(two, tc)), L::set1(p.inv_dx2)),
+                   L::mul(L::sub(L::add(tn, ts), L::mul(two, tc)), L::set1(p.inv_dy2)));
+
+    R rhs = L::sub(L::mul(L::set1(p.alpha), lap), conv);
+    L::store(t_new + i, L::add(tc, L::mul(L::set1(p.dt), rhs)));
+}
+
+template <class Lane, bool Energy>
+void flux_row(const double *u, const double *v, const double *t, double *f, double *g, int stride, int i_begin,
+              int i_end, const RowKernelParams &params) {
+    int i = i_begin;
+    for (; i + Lane::width <= i_end; i += Lane::width) {
+        flux_cells<Lane, Energy>(u, v, t, f, g, stride, i, params);
+    }
+    for (; i < i_end; ++i) {
+        flux_cells<ScalarLane, Energy>(u, v, t, f, g, stride, i, params);
+    }
+}
+
+template <class Lane>
+void temperature_row(const double *t, const double *u, const double *v, double *t_new, int stride, int i_begin,
+                     int i_end, const RowKernelParams &params) {
+    int i = i_begin;
+    for (; i + Lane::width <= i_end; i += Lane::width) {
+        temperature_cells<Lane>(t, u, v, t_new, stride, i, params);
+    }
+    for (; i < i_end; ++i) {
+        temperature_cells<ScalarLane>(t, u, v, t_new, stride, i, params);
+    }
+}
+
+} // namespace
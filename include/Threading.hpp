@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Work-stealing queue over the tasks [0, n) for one parallel region
+ *
+ * Every thread owns a deque that initially holds a contiguous block of tasks.
+ * A thread takes tasks from the front of its own deque and, once that is empty,
+ * steals from the back of the other deques. Tasks are never added after
+ * construction, so a deque is just a range packed into one atomic word and
+ * both ends are updated by compare-and-swap.
+ */
+class TaskQueue {
+  public:
+    /**
+     * @brief Distributes the tasks evenly among the deques of the threads
+     *
+     * @param tasks number of tasks
+     * @param threads number of deques, threads beyond it only steal
+     */
+    TaskQueue(int tasks, int threads);
+
+    /**
+     * @brief Next task of the given thread
+     *
+     * @param thread id of the calling thread in the team
+     * @param[out] task index of the task to run
+     * @return false once all tasks have been taken
+     */
+    bool next(int thread, int &task);
+
+  private:
+    /// [front, back) of one deque as front << 32 | back, padded to its own cache line
+    struct alignas(64) Deque {
+        std::atomic<std::uint64_t> range;
+    };
+
+    bool pop_front(Deque &deque, int &task);
+    bool pop_back(Deque &deque, int &task);
+
+    std::vector<Deque> _deques;
+};
+
+/**
+ * @brief Thread-level parallelism inside one MPI rank
+ *
+ * The loops over the fluid cells are split among the threads of an OpenMP
+ * team, so a rank can span a whole socket or NUMA domain instead of a single
+ * core. MPI calls are only made outside of the parallel regions, i.e. the halo
+ * exchange is funneled through the main thread. Without OpenMP everything runs
+ * on one thread.
+ */
+class Threading {
+  public:
+    /**
+     * @brief Sets the number of threads of every rank
+     *
+     * @param threads number of threads, 0 keeps the OpenMP default (OMP_NUM_THREADS)
+     */
+    static void set_num_threads(int threads);
+
+    /// number of threads used by the parallel loops
+    static int num_threads();
+
+    /**
+     * @brief Block of the calling thread when [first, last) is split evenly
+     * among the threads of the current parallel region
+     *
+     * @param first beginning of the range
+     * @param last end of the range (exclusive)
+     * @return std::pair<int, int> half-open sub range of the calling thread
+     */
+    static std::pair<int, int> block(int first, int last);
+
+    /// id of the calling thread in the current parallel region
+    static int thread_id();
+
+    /**
+     * @brief Runs task(k) for k in [0, tasks) with the threads of a new parallel
+     * region, balancing uneven tasks by work stealing (see TaskQueue)
+     *
+     * Which thread runs a task is not fixed, so tasks must only write to data of
+     * their own.
+     *
+     * @param tasks number of tasks
+     * @param task callable taking the task index
+     */
+    template <typename Task> static void for_each_task(int tasks, Task &&task) {
+        const int threads = num_threads();
+        if (threads == 1 || tasks == 1) {
+            for (int k = 0; k < tasks; ++k) {
+                task(k);
+            }
+            return;
+        }
+        TaskQueue queue(tasks, threads);
+#pragma omp parallel
+        {
+            const int thread = thread_id();
+            int k;
+            while (queue.next(thread, k)) {
+                task(k);
+            }
+        }
+    }
+};
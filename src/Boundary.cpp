@@ -1,13 +1,43 @@
 #include "Boundary.hpp"
 #include "Grid.hpp"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+
+void Boundary::reset_tables(Fields &field) {
+    const int stride = field.p_matrix().imax();
+    _u_table = BoundaryTable(stride);
+    _v_table = BoundaryTable(stride);
+    _t_table = BoundaryTable(stride);
+    _p_table = BoundaryTable(stride);
+    _pressure_table = BoundaryTable(stride);
+}
+
+void Boundary::apply(Fields &field) {
+    // every table only reads the field it writes, so the fields can go one after the other
+    _u_table.apply(field.u_matrix().data(), field.u_matrix().data());
+    _v_table.apply(field.v_matrix().data(), field.v_matrix().data());
+    _t_table.apply(field.t_matrix().data(), field.t_matrix().data());
+    _p_table.apply(field.p_matrix().data(), field.p_matrix().data());
+}
+
+void Boundary::apply_pressures(Fields &field) {
+    // every cell only writes its own pressure, read from fluid neighbours
+    _pressure_table.apply_parallel(field.p_matrix().data(), field.p_matrix().data());
+}
+
+void Boundary::apply_temperatures(Fields &field) {
+    _t_table.apply(field.t_matrix().data(), field.t_matrix().data());
+}
+
 FixedWallBoundary::FixedWallBoundary(std::vector<Cell *> cells) : _cells(cells) {}
 
 FixedWallBoundary::FixedWallBoundary(std::vector<Cell *> cells, double wall_temperature)
     : _cells(cells), _wall_temperature(wall_temperature) {}
 
-void FixedWallBoundary::apply(Fields &field) {
+void FixedWallBoundary::compile(Fields &field, const Grid &grid) {
+    reset_tables(field);
+    const bool energy = field.get_energy_eq();
     int i, j;
     int imax = field.p_matrix().imax();
     int jmax = field.p_matrix().jmax();
@@ -15,251 +45,182 @@ void FixedWallBoundary::apply(Fields &field) {
         i = cell->i();
         j = cell->j();
 
-        if (cell->is_border(border_position::TOP)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.u(i, j) = 0.0;
-                field.v(i, j) = 0.0;
+        if (grid.is_border(i, j, border_position::TOP)) {
+            if (grid.is_border(i, j, border_position::RIGHT)) {
+                _u_table.set(i, j, 0.0);
+                _v_table.set(i, j, 0.0);
                 if (!(i - 1 < 0 || j - 1 < 0 || j + 1 > jmax || i + 1 > imax)) {
-                    field.u(i - 1, j) = -field.u(i - 1, j + 1);
-                    field.v(i, j - 1) = -field.v(i + 1, j - 1);
-                    if (field.get_energy_eq()) {
-                        field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i, j + 1) - field.t(i + 1, j));
+                    _u_table.set(i - 1, j, -1.0, i - 1, j + 1);
+                    _v_table.set(i, j - 1, -1.0, i + 1, j - 1);
+                    if (energy) {
+                        _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i, j + 1, -1.0, i + 1, j);
                     }
                 }
-
-            }
-
-            else if (cell->is_border(border_position::LEFT)) {
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i + 1, j);
+            } else if (grid.is_border(i, j, border_position::LEFT)) {
                 if (!(i - 1 < 0 || j - 1 < 0 || j + 1 > jmax || i + 1 > imax)) {
-                    field.u(i - 1, j) = 0.0;
-                    field.v(i, j) = 0.0;
-                    field.u(i, j) = -field.u(i, j + 1);
-                    field.v(i, j - 1) = -field.v(i - 1, j - 1);
-                    if (field.get_energy_eq()) {
-                        field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i, j + 1) - field.t(i - 1, j));
+                    _u_table.set(i - 1, j, 0.0);
+                    _v_table.set(i, j, 0.0);
+                    _u_table.set(i, j, -1.0, i, j + 1);
+                    _v_table.set(i, j - 1, -1.0, i - 1, j - 1);
+                    if (energy) {
+                        _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i, j + 1, -1.0, i - 1, j);
                     }
                 }
-
-            }
-
-            else if (cell->is_border(border_position::BOTTOM)) {
-                field.u(i, j) = -field.u(i, j - 1);
-                field.v(i, j) = 0.0;
-                field.v(i, j - 1) = 0.0;
-                field.u(i - 1, j) = 0.0;
-                if (field.get_energy_eq()) {
-                    field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i, j + 1) - field.t(i, j - 1));
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i - 1, j);
+            } else if (grid.is_border(i, j, border_position::BOTTOM)) {
+                _u_table.set(i, j, -1.0, i, j - 1);
+                _v_table.set(i, j, 0.0);
+                _v_table.set(i, j - 1, 0.0);
+                _u_table.set(i - 1, j, 0.0);
+                if (energy) {
+                    _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i, j + 1, -1.0, i, j - 1);
                 }
-            }
-
-            else {
-                field.u(i, j) = -field.u(i, j + 1);
-                field.v(i, j) = 0.0;
-                if (field.get_energy_eq()) {
-                    field.t(i, j) = 2.0 * _wall_temperature - field.t(i, j + 1);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i, j - 1);
+            } else {
+                _u_table.set(i, j, -1.0, i, j + 1);
+                _v_table.set(i, j, 0.0);
+                if (energy) {
+                    _t_table.set(i, j, -1.0, i, j + 1, 2.0 * _wall_temperature);
                 }
+                _pressure_table.set(i, j, 1.0, i, j + 1);
             }
-        }
-
-        else if (cell->is_border(border_position::BOTTOM)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.u(i, j) = 0.0;
+        } else if (grid.is_border(i, j, border_position::BOTTOM)) {
+            if (grid.is_border(i, j, border_position::RIGHT)) {
+                _u_table.set(i, j, 0.0);
                 if (!(i - 1 < 0 || j - 1 < 0 || j + 1 > jmax || i + 1 > imax)) {
-                    field.v(i, j - 1) = 0.0;
-                    field.u(i - 1, j) = -field.u(i - 1, j - 1);
-                    field.v(i, j) = -field.v(i + 1, j);
-                    if (field.get_energy_eq()) {
-                        field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i + 1, j) - field.t(i, j - 1));
+                    _v_table.set(i, j - 1, 0.0);
+                    _u_table.set(i - 1, j, -1.0, i - 1, j - 1);
+                    _v_table.set(i, j, -1.0, i + 1, j);
+                    if (energy) {
+                        _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i + 1, j, -1.0, i, j - 1);
                     }
                 }
-            } else if (cell->is_border(border_position::LEFT)) {
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i + 1, j, 1.0, i, j - 1);
+            } else if (grid.is_border(i, j, border_position::LEFT)) {
                 if (!(i - 1 < 0 || j - 1 < 0 || j + 1 > jmax || i + 1 > imax)) {
-                    field.u(i - 1, j) = 0.0;
-                    field.v(i, j - 1) = 0.0;
-                    field.u(i, j) = -field.u(i, j - 1);
-                    field.p(i, j) = 0.5 * (field.p(i, j - 1) + field.p(i - 1, j));
-                    if (field.get_energy_eq()) {
-                        field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i, j - 1) - field.t(i - 1, j));
+                    _u_table.set(i - 1, j, 0.0);
+                    _v_table.set(i, j - 1, 0.0);
+                    _u_table.set(i, j, -1.0, i, j - 1);
+                    _p_table.set(i, j, 0.5, 0.0, 1.0, i, j - 1, 1.0, i - 1, j);
+                    if (energy) {
+                        _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i, j - 1, -1.0, i - 1, j);
                     }
                 }
-            }
-
-            else {
-                field.u(i, j) = -field.u(i, j - 1);
-                field.v(i, j - 1) = 0;
-                if (field.get_energy_eq()) {
-                    field.t(i, j) = 2.0 * _wall_temperature - field.t(i, j - 1);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j - 1, 1.0, i - 1, j);
+            } else {
+                _u_table.set(i, j, -1.0, i, j - 1);
+                _v_table.set(i, j - 1, 0.0);
+                if (energy) {
+                    _t_table.set(i, j, -1.0, i, j - 1, 2.0 * _wall_temperature);
                 }
+                _pressure_table.set(i, j, 1.0, i, j - 1);
             }
-        } else if (cell->is_border(border_position::RIGHT)) {
-            if (cell->is_border(border_position::LEFT)) {
-                field.u(i, j) = 0.0;
-                field.u(i - 1, j) = 0.0;
-                field.v(i, j - 1) = 0.5 * (field.v(i + 1, j - 1) + field.v(i - 1, j - 1));
-                field.v(i, j) = -0.5 * (field.v(i + 1, j) + field.v(i - 1, j));
-                if (field.get_energy_eq()) {
-                    field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i + 1, j) - field.t(i - 1, j));
+        } else if (grid.is_border(i, j, border_position::RIGHT)) {
+            if (grid.is_border(i, j, border_position::LEFT)) {
+                _u_table.set(i, j, 0.0);
+                _u_table.set(i - 1, j, 0.0);
+                _v_table.set(i, j - 1, 0.5, 0.0, 1.0, i + 1, j - 1, 1.0, i - 1, j - 1);
+                _v_table.set(i, j, -0.5, 0.0, 1.0, i + 1, j, 1.0, i - 1, j);
+                if (energy) {
+                    _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i + 1, j, -1.0, i - 1, j);
                 }
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i + 1, j, 1.0, i - 1, j);
             } else {
-                field.u(i, j) = 0;
-                field.v(i, j) = -field.v(i + 1, j);
-                if (field.get_energy_eq()) {
-                    field.t(i, j) = 2.0 * _wall_temperature - field.t(i + 1, j);
+                _u_table.set(i, j, 0.0);
+                _v_table.set(i, j, -1.0, i + 1, j);
+                if (energy) {
+                    _t_table.set(i, j, -1.0, i + 1, j, 2.0 * _wall_temperature);
                 }
+                _pressure_table.set(i, j, 1.0, i + 1, j);
             }
-        }
-
-        else if (cell->is_border(border_position::LEFT)) {
-            field.u(i - 1, j) = 0;
-            field.v(i, j) = -field.v(i - 1, j);
-            if (field.get_energy_eq()) {
-                field.t(i, j) = 2.0 * _wall_temperature - field.t(i - 1, j);
-            }
-        }
-    }
-}
-
-void FixedWallBoundary::apply_pressures(Fields &field) {
-    int i, j;
-    for (const auto &cell : _cells) {
-        i = cell->i();
-        j = cell->j();
-        if (cell->is_border(border_position::TOP)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.p(i, j) = 0.5 * (field.p(i, j + 1) + field.p(i + 1, j));
-            } else if (cell->is_border(border_position::LEFT)) {
-                field.p(i, j) = 0.5 * (field.p(i, j + 1) + field.p(i - 1, j));
-            } else if (cell->is_border(border_position::BOTTOM)) {
-                field.p(i, j) = 0.5 * (field.p(i, j + 1) + field.p(i, j - 1));
-            } else {
-                field.p(i, j) = field.p(i, j + 1);
-            }
-        } else if (cell->is_border(border_position::BOTTOM)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.p(i, j) = 0.5 * (field.p(i + 1, j) + field.p(i, j - 1));
-            } else if (cell->is_border(border_position::LEFT)) {
-                field.p(i, j) = 0.5 * (field.p(i, j - 1) + field.p(i - 1, j));
-            }
-
-            else {
-                field.p(i, j) = field.p(i, j - 1);
+        } else if (grid.is_border(i, j, border_position::LEFT)) {
+            _u_table.set(i - 1, j, 0.0);
+            _v_table.set(i, j, -1.0, i - 1, j);
+            if (energy) {
+                _t_table.set(i, j, -1.0, i - 1, j, 2.0 * _wall_temperature);
             }
-        } else if (cell->is_border(border_position::RIGHT)) {
-            if (cell->is_border(border_position::LEFT)) {
-                field.p(i, j) = 0.5 * (field.p(i + 1, j) + field.p(i - 1, j));
-            } else {
-                field.p(i, j) = field.p(i + 1, j);
-            }
-        } else if (cell->is_border(border_position::LEFT)) {
-            field.p(i, j) = field.p(i - 1, j);
+            _pressure_table.set(i, j, 1.0, i - 1, j);
         }
     }
 }
 
 AdiabaticWallBoundary::AdiabaticWallBoundary(std::vector<Cell *> cells) : _cells(cells) {}
 
-void AdiabaticWallBoundary::apply(Fields &field) {
+void AdiabaticWallBoundary::compile(Fields &field, const Grid &grid) {
+    reset_tables(field);
     int i, j;
     for (auto &cell : _cells) {
         i = cell->i();
         j = cell->j();
-        if (cell->is_border(border_position::TOP)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.u(i, j) = 0.0;
-                field.v(i, j) = 0.0;
-                field.u(i - 1, j) = -field.u(i - 1, j + 1);
-                field.v(i, j - 1) = -field.v(i + 1, j - 1);
-                field.t(i, j) = 0.5 * (field.t(i, j + 1) + field.t(i + 1, j));
-            } else if (cell->is_border(border_position::LEFT)) {
-                field.u(i - 1, j) = 0.0;
-                field.v(i, j) = 0.0;
-                field.u(i, j) = -field.u(i, j + 1);
-                field.v(i, j - 1) = -field.v(i - 1, j - 1);
-                field.t(i, j) = 0.5 * (field.t(i, j + 1) + field.t(i - 1, j));
-            } else if (cell->is_border(border_position::BOTTOM)) {
-                field.u(i, j) = -field.u(i, j - 1);
-                field.v(i, j) = 0.0;
-                field.v(i, j - 1) = 0.0;
-                field.u(i - 1, j) = 0.0;
-                field.t(i, j) = 0.5 * (field.t(i, j + 1) + field.t(i, j - 1));
-            } else {
-                field.u(i, j) = -field.u(i, j + 1);
-                field.v(i, j) = 0.0;
-                field.t(i, j) = field.t(i, j + 1);
-            }
-        } else if (cell->is_border(border_position::BOTTOM)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.u(i, j) = 0.0;
-                field.v(i, j - 1) = 0.0;
-                field.u(i - 1, j) = -field.u(i - 1, j - 1);
-                field.v(i, j) = -field.v(i + 1, j);
-                field.t(i, j) = 0.5 * (field.t(i + 1, j) + field.t(i, j - 1));
-            } else if (cell->is_border(border_position::LEFT)) {
-                field.u(i - 1, j) = 0.0;
-                field.v(i, j - 1) = 0.0;
-                field.u(i, j) = -field.u(i, j - 1);
-                field.v(i, j) = -field.v(i - 1, j);
-                field.t(i, j) = 0.5 * (field.t(i, j - 1) + field.t(i - 1, j));
-            }
-
-            else {
-                field.u(i, j) = -field.u(i, j - 1);
-                field.v(i, j - 1) = 0;
-                field.t(i, j) = field.t(i, j - 1);
-            }
-        } else if (cell->is_border(border_position::RIGHT)) {
-            if (cell->is_border(border_position::LEFT)) {
-                field.u(i, j) = 0.0;
-                field.u(i - 1, j) = 0.0;
-                field.v(i, j - 1) = 0.5 * (field.v(i + 1, j - 1) + field.v(i - 1, j - 1));
-                field.v(i, j) = -0.5 * (field.v(i + 1, j) + field.v(i - 1, j));
-                field.t(i, j) = 0.5 * (field.t(i + 1, j) + field.t(i - 1, j));
+        if (grid.is_border(i, j, border_position::TOP)) {
+            if (grid.is_border(i, j, border_position::RIGHT)) {
+                _u_table.set(i, j, 0.0);
+                _v_table.set(i, j, 0.0);
+                _u_table.set(i - 1, j, -1.0, i - 1, j + 1);
+                _v_table.set(i, j - 1, -1.0, i + 1, j - 1);
+                _t_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i + 1, j);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i + 1, j);
+            } else if (grid.is_border(i, j, border_position::LEFT)) {
+                _u_table.set(i - 1, j, 0.0);
+                _v_table.set(i, j, 0.0);
+                _u_table.set(i, j, -1.0, i, j + 1);
+                _v_table.set(i, j - 1, -1.0, i - 1, j - 1);
+                _t_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i - 1, j);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i - 1, j);
+            } else if (grid.is_border(i, j, border_position::BOTTOM)) {
+                _u_table.set(i, j, -1.0, i, j - 1);
+                _v_table.set(i, j, 0.0);
+                _v_table.set(i, j - 1, 0.0);
+                _u_table.set(i - 1, j, 0.0);
+                _t_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i, j - 1);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j + 1, 1.0, i, j - 1);
             } else {
-                field.u(i, j) = 0;
-                field.v(i, j) = -field.v(i + 1, j);
-                field.t(i, j) = field.t(i + 1, j);
+                _u_table.set(i, j, -1.0, i, j + 1);
+                _v_table.set(i, j, 0.0);
+                _t_table.set(i, j, 1.0, i, j + 1);
+                _pressure_table.set(i, j, 1.0, i, j + 1);
             }
-        } else if (cell->is_border(border_position::LEFT)) {
-            field.u(i - 1, j) = 0;
-            field.v(i, j) = -field.v(i - 1, j);
-            field.t(i, j) = field.t(i - 1, j);
-        }
-    }
-}
-
-void AdiabaticWallBoundary::apply_pressures(Fields &field) {
-    int i, j;
-    for (const auto &cell : _cells) {
-        i = cell->i();
-        j = cell->j();
-        if (cell->is_border(border_position::TOP)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.p(i, j) = 0.5 * (field.p(i, j + 1) + field.p(i + 1, j));
-            } else if (cell->is_border(border_position::LEFT)) {
-                field.p(i, j) = 0.5 * (field.p(i, j + 1) + field.p(i - 1, j));
-            } else if (cell->is_border(border_position::BOTTOM)) {
-                field.p(i, j) = 0.5 * (field.p(i, j + 1) + field.p(i, j - 1));
+        } else if (grid.is_border(i, j, border_position::BOTTOM)) {
+            if (grid.is_border(i, j, border_position::RIGHT)) {
+                _u_table.set(i, j, 0.0);
+                _v_table.set(i, j - 1, 0.0);
+                _u_table.set(i - 1, j, -1.0, i - 1, j - 1);
+                _v_table.set(i, j, -1.0, i + 1, j);
+                _t_table.set(i, j, 0.5, 0.0, 1.0, i + 1, j, 1.0, i, j - 1);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i + 1, j, 1.0, i, j - 1);
+            } else if (grid.is_border(i, j, border_position::LEFT)) {
+                _u_table.set(i - 1, j, 0.0);
+                _v_table.set(i, j - 1, 0.0);
+                _u_table.set(i, j, -1.0, i, j - 1);
+                _v_table.set(i, j, -1.0, i - 1, j);
+                _t_table.set(i, j, 0.5, 0.0, 1.0, i, j - 1, 1.0, i - 1, j);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i, j - 1, 1.0, i - 1, j);
             } else {
-                field.p(i, j) = field.p(i, j + 1);
-            }
-        } else if (cell->is_border(border_position::BOTTOM)) {
-            if (cell->is_border(border_position::RIGHT)) {
-                field.p(i, j) = 0.5 * (field.p(i + 1, j) + field.p(i, j - 1));
-            } else if (cell->is_border(border_position::LEFT)) {
-                field.p(i, j) = 0.5 * (field.p(i, j - 1) + field.p(i - 1, j));
+                _u_table.set(i, j, -1.0, i, j - 1);
+                _v_table.set(i, j - 1, 0.0);
+                _t_table.set(i, j, 1.0, i, j - 1);
+                _pressure_table.set(i, j, 1.0, i, j - 1);
             }
-
-            else {
-                field.p(i, j) = field.p(i, j - 1);
-            }
-        } else if (cell->is_border(border_position::RIGHT)) {
-            if (cell->is_border(border_position::LEFT)) {
-                field.p(i, j) = 0.5 * (field.p(i + 1, j) + field.p(i - 1, j));
+        } else if (grid.is_border(i, j, border_position::RIGHT)) {
+            if (grid.is_border(i, j, border_position::LEFT)) {
+                _u_table.set(i, j, 0.0);
+                _u_table.set(i - 1, j, 0.0);
+                _v_table.set(i, j - 1, 0.5, 0.0, 1.0, i + 1, j - 1, 1.0, i - 1, j - 1);
+                _v_table.set(i, j, -0.5, 0.0, 1.0, i + 1, j, 1.0, i - 1, j);
+                _t_table.set(i, j, 0.5, 0.0, 1.0, i + 1, j, 1.0, i - 1, j);
+                _pressure_table.set(i, j, 0.5, 0.0, 1.0, i + 1, j, 1.0, i - 1, j);
             } else {
-                field.p(i, j) = field.p(i + 1, j);
+                _u_table.set(i, j, 0.0);
+                _v_table.set(i, j, -1.0, i + 1, j);
+                _t_table.set(i, j, 1.0, i + 1, j);
+                _pressure_table.set(i, j, 1.0, i + 1, j);
             }
-        } else if (cell->is_border(border_position::LEFT)) {
-            field.p(i, j) = field.p(i - 1, j);
+        } else if (grid.is_border(i, j, border_position::LEFT)) {
+            _u_table.set(i - 1, j, 0.0);
+            _v_table.set(i, j, -1.0, i - 1, j);
+            _t_table.set(i, j, 1.0, i - 1, j);
+            _pressure_table.set(i, j, 1.0, i - 1, j);
         }
     }
 }
@@ -272,25 +233,16 @@ MovingWallBoundary::MovingWallBoundary(std::vector<Cell *> cells, std::map<int,
                                        double wall_temperature)
     : _cells(cells), _wall_velocity(wall_velocity), _wall_temperature(wall_temperature) {}
 
-void MovingWallBoundary::apply(Fields &field) {
-    unsigned int i, j;
+void MovingWallBoundary::compile(Fields &field, const Grid &grid) {
+    reset_tables(field);
+    int i, j;
     for (auto &cell : _cells) {
-        if (cell->is_border(border_position::BOTTOM)) {
-            i = cell->i();
-            j = cell->j();
-            field.u(i, j) = 2.0 * LidDrivenCavity::wall_velocity - field.u(i, j - 1);
-            field.v(i, j - 1) = 0;
-        }
-    }
-}
-
-void MovingWallBoundary::apply_pressures(Fields &field) {
-    unsigned int i, j;
-    for (const auto &cell : _cells) {
-        if (cell->is_border(border_position::BOTTOM)) {
-            i = cell->i();
-            j = cell->j();
-            field.p(i, j) = field.p(i, j - 1);
+        i = cell->i();
+        j = cell->j();
+        if (grid.is_border(i, j, border_position::BOTTOM)) {
+            _u_table.set(i, j, -1.0, i, j - 1, 2.0 * LidDrivenCavity::wall_velocity);
+            _v_table.set(i, j - 1, 0.0);
+            _pressure_table.set(i, j, 1.0, i, j - 1);
         }
     }
 }
@@ -301,37 +253,26 @@ InFlow::InFlow(std::vector<Cell *> cells, std::map<int, double> inlet_velocity)
 InFlow::InFlow(std::vector<Cell *> cells, std::map<int, double> inlet_velocity, double wall_temperature)
     : _cells(cells), _inlet_velocity(inlet_velocity), _wall_temperature(wall_temperature){};
 
-void InFlow::apply(Fields &field) {
-    unsigned int i, j;
+void InFlow::compile(Fields &field, const Grid &grid) {
+    reset_tables(field);
+    // assuming inlet velocity is only in u
+    const double inlet_velocity = _inlet_velocity[PlaneShearFlow::inflow_wall_id];
+    int i, j;
     for (const auto &cell : _cells) {
         i = cell->i();
         j = cell->j();
-        if (cell->is_border(border_position::RIGHT)) {
-            // assuming inlet velocity is only in u
-            field.u(i, j) = _inlet_velocity[PlaneShearFlow::inflow_wall_id];
-            field.v(i, j) = -field.v(i + 1, j);
+        if (grid.is_border(i, j, border_position::RIGHT)) {
+            _u_table.set(i, j, inlet_velocity);
+            _v_table.set(i, j, -1.0, i + 1, j);
             if (field.get_energy_eq()) {
-                field.t(i, j) = 0.5 * (4.0 * _wall_temperature - field.t(i, j + 1) - field.t(i + 1, j));
+                _t_table.set(i, j, 0.5, 4.0 * _wall_temperature, -1.0, i, j + 1, -1.0, i + 1, j);
             }
+            _pressure_table.set(i, j, 1.0, i + 1, j);
         }
-        if (cell->is_border(border_position::LEFT)) {
-            field.u(i - 1, j) = _inlet_velocity[PlaneShearFlow::inflow_wall_id];
-            field.v(i, j) = -field.v(i - 1, j);
-        }
-    }
-}
-
-void InFlow::apply_pressures(Fields &field) {
-    unsigned int i, j;
-    for (const auto &cell : _cells) {
-        i = cell->i();
-        j = cell->j();
-        if (cell->is_border(border_position::RIGHT)) {
-            // assuming inlet velocity is only in u
-            field.p(i, j) = field.p(i + 1, j);
-        }
-        if (cell->is_border(border_position::LEFT)) {
-            field.p(i, j) = field.p(i - 1, j);
+        if (grid.is_border(i, j, border_position::LEFT)) {
+            _u_table.set(i - 1, j, inlet_velocity);
+            _v_table.set(i, j, -1.0, i - 1, j);
+            _pressure_table.set(i, j, 1.0, i - 1, j);
         }
     }
 }
@@ -341,48 +282,112 @@ OutFlow::OutFlow(std::vector<Cell *> cells, double outlet_pressure)
 OutFlow::OutFlow(std::vector<Cell *> cells, double wall_temperature, double outlet_pressure)
     : _cells(cells), _wall_temperature(wall_temperature), _outlet_pressure(outlet_pressure){};
 
-void OutFlow::apply(Fields &field) {
-    // this deals with boundary sharing on only one border of the cell.
-    unsigned int i, j;
+ConvectiveOutFlow::ConvectiveOutFlow(std::vector<Cell *> cells, double outlet_pressure)
+    : _cells(cells), _outlet_pressure(outlet_pressure){};
+
+void ConvectiveOutFlow::add(std::vector<Transport> &transports, const Matrix<double> &matrix, int i, int j, int fi,
+                            int fj, int normal, bool normal_in_u, double sign, double spacing) {
+    const int stride = matrix.imax();
+    transports.push_back(
+        Transport{stride * j + i, stride * fj + fi, normal, normal_in_u, sign, spacing, matrix(i, j)});
+}
+
+void ConvectiveOutFlow::compile(Fields &field, const Grid &grid) {
+    reset_tables(field);
+    _u_transports.clear();
+    _v_transports.clear();
+    const auto &u = field.u_matrix();
+    const auto &v = field.v_matrix();
+    const int stride = u.imax();
+    const double dx = grid.dx();
+    const double dy = grid.dy();
+    int i, j;
     for (const auto &cell : _cells) {
         i = cell->i();
         j = cell->j();
-        if (cell->is_border(border_position::LEFT)) {
-            field.u(i - 1, j) = field.u(i - 2, j);
-            field.v(i - 1, j) = field.v(i - 2, j);
+        // the normal velocity lives on the face towards the fluid, the tangential one in the boundary cell
+        if (grid.is_border(i, j, border_position::LEFT)) {
+            const int normal = stride * j + i - 1;
+            add(_u_transports, u, i - 1, j, i - 2, j, normal, true, 1.0, dx);
+            add(_v_transports, v, i, j, i - 1, j, normal, true, 1.0, dx);
+            _pressure_table.set(i, j, -1.0, i - 1, j, 2 * _outlet_pressure);
         }
-        if (cell->is_border(border_position::RIGHT)) {
-            field.u(i, j) = field.u(i + 1, j);
-            field.v(i, j) = field.v(i + 1, j);
+        if (grid.is_border(i, j, border_position::RIGHT)) {
+            const int normal = stride * j + i;
+            add(_u_transports, u, i, j, i + 1, j, normal, true, -1.0, dx);
+            add(_v_transports, v, i, j, i + 1, j, normal, true, -1.0, dx);
+            _pressure_table.set(i, j, -1.0, i + 1, j, 2 * _outlet_pressure);
         }
-        if (cell->is_border(border_position::TOP)) {
-            field.u(i, j) = field.u(i, j + 1);
-            field.v(i, j) = field.v(i, j + 1);
+        if (grid.is_border(i, j, border_position::TOP)) {
+            const int normal = stride * j + i;
+            add(_v_transports, v, i, j, i, j + 1, normal, false, -1.0, dy);
+            add(_u_transports, u, i, j, i, j + 1, normal, false, -1.0, dy);
+            _pressure_table.set(i, j, -1.0, i, j + 1, 2 * _outlet_pressure);
         }
-        if (cell->is_border(border_position::BOTTOM)) {
-            field.u(i, j - 1) = field.u(i, j);
-            field.v(i, j - 1) = field.v(i, j);
+        if (grid.is_border(i, j, border_position::BOTTOM)) {
+            const int normal = stride * (j - 1) + i;
+            add(_v_transports, v, i, j - 1, i, j - 2, normal, false, 1.0, dy);
+            add(_u_transports, u, i, j, i, j - 1, normal, false, 1.0, dy);
+            _pressure_table.set(i, j, -1.0, i, j - 1, 2 * _outlet_pressure);
         }
     }
 }
 
-void OutFlow::apply_pressures(Fields &field) {
+void ConvectiveOutFlow::advance(Fields &field) {
+    const double dt = field.dt();
+    double *u = field.u_matrix().data();
+    double *v = field.v_matrix().data();
+    // all transport speeds are taken before any normal velocity is overwritten
+    std::vector<double> courant_u(_u_transports.size());
+    std::vector<double> courant_v(_v_transports.size());
+    auto courant = [&](const Transport &t) {
+        const double normal = t.normal_in_u ? u[t.normal] : v[t.normal];
+        return std::max(0.0, t.sign * normal) * dt / t.spacing;
+    };
+    for (std::size_t k = 0; k < _u_transports.size(); ++k) {
+        courant_u[k] = courant(_u_transports[k]);
+    }
+    for (std::size_t k = 0; k < _v_transports.size(); ++k) {
+        courant_v[k] = courant(_v_transports[k]);
+    }
+    auto transport = [](Transport &t, double *x, double c) {
+        t.value = (t.value + c * x[t.fluid]) / (1.0 + c);
+        x[t.target] = t.value;
+    };
+    for (std::size_t k = 0; k < _u_transports.size(); ++k) {
+        transport(_u_transports[k], u, courant_u[k]);
+    }
+    for (std::size_t k = 0; k < _v_transports.size(); ++k) {
+        transport(_v_transports[k], v, courant_v[k]);
+    }
+}
+
+void OutFlow::compile(Fields &field, const Grid &grid) {
     // this deals with boundary sharing on only one border of the cell.
-    unsigned int i, j;
+    reset_tables(field);
+    int i, j;
     for (const auto &cell : _cells) {
         i = cell->i();
         j = cell->j();
-        if (cell->is_border(border_position::LEFT)) {
-            field.p(i, j) = 2 * _outlet_pressure - field.p(i - 1, j);
+        if (grid.is_border(i, j, border_position::LEFT)) {
+            _u_table.set(i - 1, j, 1.0, i - 2, j);
+            _v_table.set(i - 1, j, 1.0, i - 2, j);
+            _pressure_table.set(i, j, -1.0, i - 1, j, 2 * _outlet_pressure);
         }
-        if (cell->is_border(border_position::RIGHT)) {
-            field.p(i, j) = 2 * _outlet_pressure - field.p(i + 1, j);
+        if (grid.is_border(i, j, border_position::RIGHT)) {
+            _u_table.set(i, j, 1.0, i + 1, j);
+            _v_table.set(i, j, 1.0, i + 1, j);
+            _pressure_table.set(i, j, -1.0, i + 1, j, 2 * _outlet_pressure);
         }
-        if (cell->is_border(border_position::TOP)) {
-            field.p(i, j) = 2 * _outlet_pressure - field.p(i, j + 1);
+        if (grid.is_border(i, j, border_position::TOP)) {
+            _u_table.set(i, j, 1.0, i, j + 1);
+            _v_table.set(i, j, 1.0, i, j + 1);
+            _pressure_table.set(i, j, -1.0, i, j + 1, 2 * _outlet_pressure);
         }
-        if (cell->is_border(border_position::BOTTOM)) {
-            field.p(i, j) = 2 * _outlet_pressure - field.p(i, j - 1);
+        if (grid.is_border(i, j, border_position::BOTTOM)) {
+            _u_table.set(i, j - 1, 1.0, i, j);
+            _v_table.set(i, j - 1, 1.0, i, j);
+            _pressure_table.set(i, j, -1.0, i, j - 1, 2 * _outlet_pressure);
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,38 @@
+#include "BoundaryTable.hpp"
+
+namespace {
+inline void run(const BoundaryUpdate &u, const double *source, double *target) {
+    target[u.target] = u.scale * ((u.constant + u.c1 * source[u.source1]) + u.c2 * source[u.source2]);
+}
+} // namespace
+
+BoundaryTable::BoundaryTable(int stride) : _stride(stride) {}
+
+void BoundaryTable::set(int i, int j, double value) {
+    const int t = index(i, j);
+    _updates.push_back(BoundaryUpdate{t, t, t, 0.0, 0.0, value, 1.0});
+}
+
+void BoundaryTable::set(int i, int j, double coeff, int si, int sj, double constant) {
+    const int s = index(si, sj);
+    _updates.push_back(BoundaryUpdate{index(i, j), s, s, coeff, 0.0, constant, 1.0});
+}
+
+void BoundaryTable::set(int i, int j, double scale, double constant, double c1, int si1, int sj1, double c2, int si2,
+                        int sj2) {
+    _updates.push_back(BoundaryUpdate{index(i, j), index(si1, sj1), index(si2, sj2), c1, c2, constant, scale});
+}
+
+void BoundaryTable::apply(const double *source, double *target) const {
+    for (const auto &u : _updates) {
+        run(u, source, target);
+    }
+}
+
+void BoundaryTable::apply_parallel(const double *source, double *target) const {
+    const int n = static_cast<int>(_updates.size());
+#pragma omp parallel for
+    for (int k = 0; k < n; ++k) {
+        run(_updates[k], source, target);
+    }
+}
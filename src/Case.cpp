@@ -1,9 +1,11 @@
 
 #include "Case.hpp"
 #include "Communication.hpp"
+#include "Decomposition.hpp"
 #include "Enums.hpp"
 
 #include <algorithm>
+#include <cmath>
 #ifdef GCC_VERSION_9_OR_HIGHER
 #include <filesystem>
 #else
@@ -31,7 +33,15 @@ namespace filesystem = std::experimental::filesystem;
 #include <vtkStructuredGridWriter.h>
 #include <vtkTuple.h>
 
-Case::~Case() { Communication::finalize(); }
+Case::~Case() {
+    // the shared memory windows have to go before MPI does
+    Communication::free_exchange(_temperature_halo);
+    Communication::free_exchange(_flux_halo);
+    Communication::free_exchange(_pressure_halo);
+    Communication::free_exchange(_velocity_halo);
+    _pressure_solver.reset();
+    Communication::finalize();
+}
 
 Case::Case(std::string file_name, int argn, char **args, int process_rank, int size, int my_rank) {
     // Read input parameters
@@ -63,6 +73,9 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
     double T3;     /*3rd wall temperature */
     double T4;     /*4rd wall temperature */
     double T5;     /*5rd wall temperature */
+    // Worksheet 3 Additions
+    std::string iproc{"1"}; /* number of processes x-direction, or auto */
+    std::string jproc{"1"}; /* number of processes y-direction, or auto */
 
     if (file.is_open()) {
 
@@ -101,30 +114,74 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
                 if (var == "wall_temp_4") file >> T4;
                 if (var == "wall_temp_5") file >> T5;
                 // Worksheet 3 Additions
-                if (var == "iproc") file >> _iproc;
-                if (var == "jproc") file >> _jproc;
+                if (var == "iproc") file >> iproc;
+                if (var == "jproc") file >> jproc;
                 // Project Additions
                 if (var == "solver") file >> _solver_type;
                 if (var == "MultiGrid_levels") file >> _num_levels;
+                if (var == "MultiGrid_block") file >> _mg_block_sweeps;
+                if (var == "simd") file >> _simd;
+                if (var == "fused_step") file >> _fused_step;
+                if (var == "num_threads") file >> _num_threads;
+                if (var == "diffusion") file >> _diffusion;
+                if (var == "diffusion_eps") file >> _diffusion_tolerance;
+                if (var == "steady_eps") file >> _steady_tolerance;
+                if (var == "steady_window") file >> _steady_window;
+                if (var == "pressure_bc") file >> _pressure_bc;
+                if (var == "time_integrator") file >> _time_integrator;
+                if (var == "energy_subcycling") file >> _energy_subcycling;
+                if (var == "decomposition") file >> _decomposition;
+                if (var == "halo_exchange") file >> _halo_exchange;
+                if (var == "halo_depth") file >> _requested_halo_depth;
+                if (var == "rebalance_interval") file >> _rebalance_interval;
+                if (var == "rebalance_threshold") file >> _rebalance_threshold;
             }
         }
     }
 
     file.close();
 
+    if (_diffusion != "implicit") {
+        _diffusion = "explicit";
+    }
+    // the implicitly diffused fluxes are only final after their own solve
+    if (_fused_step != "off" && _diffusion == "explicit") {
+        _fused_step = "on";
+    } else {
+        _fused_step = "off";
+    }
+    if (_pressure_bc != "folded") {
+        _pressure_bc = "ghost";
+    }
+    // the deep halo sweeps need no boundaries between them, which only works for Jacobi with folded boundaries
+    if (_requested_halo_depth < 1 || _pressure_bc != "folded" ||
+        (_solver_type != "Jacobi" && _solver_type != "WeightedJacobi")) {
+        _requested_halo_depth = 1;
+    }
+    // the higher order integrators combine explicit steps only
+    if ((_time_integrator != "ab2" && _time_integrator != "rk3") || _diffusion == "implicit") {
+        _time_integrator = "euler";
+    }
+    // without explicit thermal diffusion there is no separate temperature timestep
+    if (_energy_subcycling != "on" || _energy_eq != "on" || _diffusion == "implicit" ||
+        _time_integrator != "euler") {
+        _energy_subcycling = "off";
+    }
+    if (_decomposition != "balanced") {
+        _decomposition = "uniform";
+    }
+    if (_halo_exchange != "messages") {
+        _halo_exchange = "shared";
+    }
+    // a single process has nothing to balance
+    if (_rebalance_interval < 0 || size == 1) {
+        _rebalance_interval = 0;
+    }
+    Threading::set_num_threads(_num_threads);
+
     _process_rank = process_rank;
     _size = size;
 
-    if (_iproc * _jproc != _size) {
-        Communication::finalize();
-        if (_process_rank == 0) {
-            std::cerr << "please check your iproc(number of processes for x-direction) and jproc(number of processes "
-                         "for y-direction). Their product should be the total number of processes for the problem"
-                      << std::endl;
-        }
-        exit(0);
-    }
-
     _datfile_name = file_name;
 
     std::map<int, double> wall_vel;
@@ -140,9 +197,32 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
     domain.domain_size_x = imax;
     domain.domain_size_y = jmax;
 
+    // "auto" for either of them leaves the process grid to the decomposition
+    _auto_process_grid = (iproc == "auto" || jproc == "auto");
+    if (_auto_process_grid) {
+        choose_process_grid(imax, jmax);
+    } else {
+        _iproc = std::stoi(iproc);
+        _jproc = std::stoi(jproc);
+    }
+
+    if (_iproc * _jproc != _size) {
+        Communication::finalize();
+        if (_process_rank == 0) {
+            std::cerr << "please check your iproc(number of processes for x-direction) and jproc(number of processes "
+                         "for y-direction). Their product should be the total number of processes for the problem"
+                      << std::endl;
+        }
+        exit(0);
+    }
+    // neighbouring subdomains may be placed closer together from here on, with new ranks
+    Communication::create_topology(_iproc, _jproc, _process_rank, _halo_exchange == "shared");
+
     build_domain(domain, imax, jmax);
 
     _grid = Grid(_geom_name, domain, _process_rank, _size, _iproc, _jproc);
+    _fluid_cells = Communication::reduce_sum(static_cast<double>(_grid.fluid_cells().size()));
+    fit_halo_depth();
 
     // Assigning hot and cold temperatues accordingly
     if (_grid.get_hot_fixed_wall_id() == 3) {
@@ -164,17 +244,60 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
         Tc = T5;
     }
 
+    _discretization = Discretization(domain.dx, domain.dy, gamma);
+
     _field = Fields(_grid, nu, dt, tau, alpha, beta, _energy_eq, _grid.domain().size_x, _grid.domain().size_y, UI, VI,
                     PI, TI, GX, GY, _process_rank, _size);
+    // Physics configuration is fixed from here on, pick the specialized kernels once
+    _simd_isa = SimdKernels::select(_simd);
+    _field.select_kernels(_discretization, _simd_isa);
+    _field.set_implicit_diffusion(_grid, _diffusion == "implicit");
+    _field.set_energy_subcycling(_energy_subcycling == "on");
+    Communication::init_exchange({&_field.t_matrix()}, domain, _temperature_halo);
+    Communication::init_exchange({&_field.f_matrix(), &_field.g_matrix()}, domain, _flux_halo);
+    Communication::init_exchange({&_field.p_matrix()}, domain, _pressure_halo);
+    Communication::init_exchange({&_field.u_matrix(), &_field.v_matrix()}, domain, _velocity_halo);
+    if (_time_integrator == "ab2") {
+        _field.set_time_integrator(time_integrator::AB2);
+    } else if (_time_integrator == "rk3") {
+        _field.set_time_integrator(time_integrator::SSP_RK3);
+    }
 
-    _discretization = Discretization(domain.dx, domain.dy, gamma);
+    if (_solver_type == "MultiGridV" && _num_levels > (std::log2((imax < jmax) ? imax : jmax) - 1)) {
+        _num_levels = std::log2((imax < jmax) ? imax : jmax) - 1;
+    }
+    _omg = omg;
+    build_pressure_solver();
 
-    if (_solver_type == "Jacobi") {
+    _max_iter = itermax;
+    _tolerance = eps;
+    // Construct boundaries
+    _hot_temperature = Th;
+    _cold_temperature = Tc;
+    _inflow_velocity = UI;
+    build_boundaries();
+
+    if (_process_rank == 0) {
+        output_log(_datfile_name, nu, UI, VI, PI, GX, GY, xlength, ylength, dt, imax, jmax, gamma, omg, tau, itermax,
+                   eps, TI, alpha, beta, num_walls, Tc, Th, my_rank);
+    }
+}
+
+void Case::build_pressure_solver() {
+    if (_solver_type == "Jacobi" && _halo_depth > 1) {
+        _pressure_solver = std::make_unique<DeepHaloJacobi>(_halo_depth);
+    }
+
+    else if (_solver_type == "Jacobi") {
         _pressure_solver = std::make_unique<Jacobi>();
     }
 
+    else if (_solver_type == "WeightedJacobi" && _halo_depth > 1) {
+        _pressure_solver = std::make_unique<DeepHaloJacobi>(_halo_depth, _omg);
+    }
+
     else if (_solver_type == "WeightedJacobi") {
-        _pressure_solver = std::make_unique<WeightedJacobi>(omg);
+        _pressure_solver = std::make_unique<WeightedJacobi>(_omg);
     }
 
     else if (_solver_type == "GaussSeidel") {
@@ -182,7 +305,7 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
     }
 
     else if (_solver_type == "Richardson") {
-        _pressure_solver = std::make_unique<Richardson>(omg);
+        _pressure_solver = std::make_unique<Richardson>(_omg);
     }
 
     else if (_solver_type == "ConjugateGradient") {
@@ -190,21 +313,28 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
     }
 
     else if (_solver_type == "MultiGridV") {
-        if (_num_levels > (std::log2((imax < jmax) ? imax : jmax) - 1)) {
-            _num_levels = std::log2((imax < jmax) ? imax : jmax) - 1;
-        }
-
-        _pressure_solver = std::make_unique<MultiGridVCycle>(_num_levels, 5, 5);
+        _pressure_solver = std::make_unique<MultiGridVCycle>(_num_levels, 5, 5, _mg_block_sweeps);
     }
 
     else {
         _solver_type = "SOR";
-        _pressure_solver = std::make_unique<SOR>(omg);
+        _pressure_solver = std::make_unique<SOR>(_omg);
     }
+    if (_pressure_bc == "folded") {
+        _pressure_solver->fold_boundaries(_grid, _outlet_pressure);
+    }
+}
 
-    _max_iter = itermax;
-    _tolerance = eps;
-    // Construct boundaries
+void Case::fit_halo_depth() {
+    // the neighbours fill the ghost layers from their own cells
+    _halo_depth = std::min(_requested_halo_depth, static_cast<int>(Communication::reduce_min(std::min(
+                                                      _grid.domain().size_x, _grid.domain().size_y))));
+}
+
+void Case::build_boundaries() {
+    _boundaries.clear();
+    // the implicit diffusion timestep follows the velocities the walls and inlets are configured with
+    double driving_velocity = 0.0;
     if (not _grid.fixed_wall_cells().empty()) {
         _boundaries.push_back(std::make_unique<FixedWallBoundary>(_grid.fixed_wall_cells()));
     }
@@ -212,14 +342,15 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
     if (not _grid.moving_wall_cells().empty()) {
         _boundaries.push_back(
             std::make_unique<MovingWallBoundary>(_grid.moving_wall_cells(), LidDrivenCavity::wall_velocity));
+        driving_velocity = std::max(driving_velocity, std::abs(LidDrivenCavity::wall_velocity));
     }
 
     if (not _grid.hot_fixed_wall_cells().empty()) {
-        _boundaries.push_back(std::make_unique<FixedWallBoundary>(_grid.hot_fixed_wall_cells(), Th));
+        _boundaries.push_back(std::make_unique<FixedWallBoundary>(_grid.hot_fixed_wall_cells(), _hot_temperature));
     }
 
     if (not _grid.cold_fixed_wall_cells().empty()) {
-        _boundaries.push_back(std::make_unique<FixedWallBoundary>(_grid.cold_fixed_wall_cells(), Tc));
+        _boundaries.push_back(std::make_unique<FixedWallBoundary>(_grid.cold_fixed_wall_cells(), _cold_temperature));
     }
 
     if (not _grid.adiabatic_fixed_wall_cells().empty()) {
@@ -227,19 +358,26 @@ Case::Case(std::string file_name, int argn, char **args, int process_rank, int s
     }
 
     if (not _grid.inflow_cells().empty()) {
-        _boundaries.push_back(std::make_unique<InFlow>(_grid.inflow_cells(),
-                                                       std::map<int, double>{{PlaneShearFlow::inflow_wall_id, UI}}));
+        _boundaries.push_back(std::make_unique<InFlow>(
+            _grid.inflow_cells(), std::map<int, double>{{PlaneShearFlow::inflow_wall_id, _inflow_velocity}}));
+        driving_velocity = std::max(driving_velocity, std::abs(_inflow_velocity));
     }
 
     if (not _grid.outflow_cells().empty()) {
-        _boundaries.push_back(std::make_unique<OutFlow>(_grid.outflow_cells(), 0.0));
+        _boundaries.push_back(std::make_unique<OutFlow>(_grid.outflow_cells(), _outlet_pressure));
     }
 
-    if (_process_rank == 0) {
-        output_log(_datfile_name, nu, UI, VI, PI, GX, GY, xlength, ylength, dt, imax, jmax, gamma, omg, tau, itermax,
-                   eps, TI, alpha, beta, num_walls, Tc, Th, my_rank);
+    if (not _grid.convective_outflow_cells().empty()) {
+        _boundaries.push_back(
+            std::make_unique<ConvectiveOutFlow>(_grid.convective_outflow_cells(), _outlet_pressure));
+    }
+    _field.set_driving_velocity(driving_velocity);
+    // the boundary branches only run once, the time loop applies the compiled tables
+    for (auto &boundary : _boundaries) {
+        boundary->compile(_field, _grid);
     }
 }
+
 void Case::set_file_names(std::string file_name) {
     std::string temp_dir;
     bool case_name_flag = true;
@@ -309,7 +447,7 @@ void Case::simulate(int my_rank) {
     int output_counter = 0;
     double t_end = _t_end;
     double err = 100;
-    // starting simulation
+    // starting simulation, PPE iterations of all stages of the step
     int iter_count = 0;
 
     Case::output_vtk(timestep, my_rank);
@@ -329,55 +467,78 @@ void Case::simulate(int my_rank) {
         }
     }
 
-    int fluid_cells;
+    // steady state detection: time since which the fields change slower than _steady_tolerance
+    double steady_since = t;
+    bool steady = false;
+    // set once the monitored fields are no longer finite
+    bool diverged = false;
+    int last_output_step = -1;
+    // own work of this process in the timesteps since the last rebalancing, without the time spent waiting for
+    // the others, the output and the rebalancing itself
+    double busy_time = 0.0;
 
     while (t < t_end) {
-        err = 100.0;
-        iter_count = 0;
-        dt = _field.calculate_dt(_grid);
-        dt = Communication::reduce_min(dt);
+        const double step_start = MPI_Wtime();
+        const double step_wait = Communication::wait_time();
+        // boundary values first, advance() still needs the size of the last timestep
+        if (timestep > 0) {
+            // time dependent boundary values catch up with the last timestep
+            for (const auto &boundary : _boundaries) {
+                boundary->advance(_field);
+            }
+        }
         for (size_t i = 0; i < _boundaries.size(); i++) {
             _boundaries[i]->apply(_field);
         }
-        if (Case::_energy_eq == "on") {
-            _field.calculate_temperatures(_grid);
-            // communicate temperature
-            Communication::communicate(_field.t_matrix(), domain);
+        dt = _field.calculate_dt(_grid);
+        // all processes have to advance with the same timestep
+        Reduction timesteps;
+        const int dt_slot = timesteps.min(dt);
+        const int temperature_dt_slot = timesteps.min(_field.temperature_dt());
+        timesteps.reduce();
+        dt = timesteps[dt_slot];
+        _field.set_dt(dt);
+        iter_count = 0;
+        bool converged = true;
+        if (_field.energy_subcycling()) {
+            _field.store_step_velocities();
         }
-        _field.calculate_fluxes(_grid);
-
-        // communicate fluxes
-        Communication::communicate(_field.f_matrix(), domain);
-        Communication::communicate(_field.g_matrix(), domain);
-        _field.calculate_rs(_grid);
-        while (err > _tolerance && iter_count < _max_iter) {
-            err = _pressure_solver->solve(_field, _grid, _boundaries);
-            for (const auto &boundary : _boundaries) {
-                boundary->apply_pressures(_field);
+        for (int stage = 0; stage < _field.stages(); ++stage) {
+            _field.begin_stage(stage);
+            if (stage > 0) {
+                // the stage starts from the velocities and temperatures of the previous one
+                for (const auto &boundary : _boundaries) {
+                    boundary->apply(_field);
+                }
             }
-            // weighted addition of residuals
-            err = Communication::reduce_sum(err);
-            fluid_cells = _grid.fluid_cells().size();
-            fluid_cells = Communication::reduce_sum(fluid_cells);
-            err = std::sqrt(err / fluid_cells);
-            // communicate pressures
-            Communication::communicate(_field.p_matrix(), domain);
-            iter_count += 1;
-        }
-        _field.calculate_velocities(_grid);
-        // exchange velocities
-        Communication::communicate(_field.u_matrix(), domain);
-        Communication::communicate(_field.v_matrix(), domain);
+            err = advance_stage(iter_count);
+            converged = converged && err <= _tolerance;
+        }
+        int substeps = 1;
+        if (_field.energy_subcycling()) {
+            substeps = subcycle_temperatures(timesteps[temperature_dt_slot]);
+        }
         t += dt;
         timestep += 1;
+        busy_time += (MPI_Wtime() - step_start) - (Communication::wait_time() - step_wait);
+        // the changes are reduced while the output is written
+        Reduction change;
+        if (_steady_tolerance > 0.0) {
+            start_state_change(change);
+        }
         if (_process_rank == 0) {
             output << std::setprecision(6) << std::fixed;
         }
         if (t - output_counter * _output_freq >= 0) {
             Case::output_vtk(timestep, my_rank);
+            last_output_step = timestep;
             if (_process_rank == 0) {
-                output << "Time: " << t << " Residual: " << err << " PPE Iterations: " << iter_count << std::endl;
-                if (iter_count == _max_iter || std::isnan(err)) {
+                output << "Time: " << t << " Residual: " << err << " PPE Iterations: " << iter_count;
+                if (_field.energy_subcycling()) {
+                    output << " Temperature substeps: " << substeps;
+                }
+                output << std::endl;
+                if (!converged) {
                     std::cout << "The PPE Solver didn't converge for Time = " << t
                               << " Please check the log file and increase max iterations or other parameters for "
                                  "convergence"
@@ -405,11 +566,47 @@ void Case::simulate(int my_rank) {
                 last_progress = progress;
             }
         }
+        if (_steady_tolerance > 0.0) {
+            const double rate = state_change_rate(change, dt);
+            if (std::isnan(rate)) {
+                diverged = true;
+            } else if (rate > _steady_tolerance) {
+                steady_since = t;
+            } else if (t - steady_since >= _steady_window) {
+                steady = true;
+            }
+        }
+        if (diverged) {
+            if (_process_rank == 0) {
+                output << "Diverged at Time: " << t << " Time Step: " << timestep << std::endl;
+                std::cerr << "\nThe simulation diverged at Time = " << t
+                          << ", the fields are no longer finite. Please reduce tau or the timestep" << std::endl;
+            }
+            break;
+        }
+        if (steady) {
+            if (_process_rank == 0) {
+                output << "Steady state reached at Time: " << t << " Time Step: " << timestep << std::endl;
+                std::cout << "\nSteady state reached at Time = " << t << "\n";
+            }
+            break;
+        }
+        if (_rebalance_interval > 0 && timestep % _rebalance_interval == 0 && t < t_end) {
+            const double imbalance = rebalance(busy_time);
+            if (imbalance > 0.0 && _process_rank == 0) {
+                output << "Rebalanced at Time Step: " << timestep << " Imbalance: " << imbalance;
+                if (_requested_halo_depth > 1) {
+                    output << " Halo depth: " << _halo_depth;
+                }
+                output << std::endl;
+            }
+            busy_time = 0.0;
+        }
     }
 
-    if (t_end !=
-        (output_counter - 1) * _output_freq) // Recording at t_end if the output frequency is not a multiple of t_end
-    {
+    // Recording at t_end if the output frequency is not a multiple of t_end, or the final steady state;
+    // a diverged state is not worth writing
+    if (!diverged && (steady ? last_output_step != timestep : t_end != (output_counter - 1) * _output_freq)) {
         Case::output_vtk(timestep, my_rank);
         if (_process_rank == 0) {
             output << "Time Step: " << timestep << " Residue: " << err << " PPE Iterations: " << iter_count
@@ -423,6 +620,118 @@ void Case::simulate(int my_rank) {
     output.close();
 }
 
+double Case::advance_stage(int &iter_count) {
+    // a subcycled temperature is advanced after the momentum step
+    if (_field.get_energy_eq() && !_field.energy_subcycling()) {
+        _field.calculate_temperatures(_grid);
+        if (_field.implicit_diffusion()) {
+            solve_diffusion(&Fields::diffuse_temperature, _temperature_halo);
+        }
+        // communicate temperature
+        Communication::communicate(_temperature_halo);
+    }
+    if (_fused_step == "on") {
+        _field.calculate_fluxes_rs(_grid);
+    } else {
+        _field.calculate_fluxes(_grid);
+    }
+
+    // communicate fluxes
+    Communication::communicate(_flux_halo);
+    if (_field.implicit_diffusion()) {
+        solve_diffusion(&Fields::diffuse_velocities, _flux_halo);
+    }
+    if (_fused_step == "on") {
+        _field.calculate_rs_rim(_grid);
+    } else {
+        _field.calculate_rs(_grid);
+    }
+    double err = 100.0;
+    _pressure_solver->start_solve();
+    const int sweeps = _pressure_solver->sweeps();
+    for (int iter = 0; err > _tolerance && iter < _max_iter; iter += sweeps) {
+        Communication::finish_exchange(_pressure_halo);
+        err = _pressure_solver->solve(_field, _grid, _boundaries);
+        if (!_pressure_solver->folded()) {
+            for (const auto &boundary : _boundaries) {
+                boundary->apply_pressures(_field);
+            }
+        }
+        // communicate pressures while the residuals are summed up, the next sweep waits for them
+        if (!_pressure_solver->exchanges_halos()) {
+            Communication::start_exchange(_pressure_halo);
+        }
+        // weighted addition of residuals
+        err = Communication::reduce_sum(err);
+        err = std::sqrt(err / _fluid_cells);
+        iter_count += sweeps;
+    }
+    if (_pressure_solver->exchanges_halos()) {
+        // the last sweeps left the ghost layer of the subdomain behind
+        Communication::start_exchange(_pressure_halo);
+    }
+    if (_pressure_solver->folded()) {
+        Communication::finish_exchange(_pressure_halo);
+        // the ghost pressures are only needed for the velocity update and the output
+        for (const auto &boundary : _boundaries) {
+            boundary->apply_pressures(_field);
+        }
+    }
+    // the velocities away from the subdomain frame need no pressure halo and hide the last exchange
+    if (_fused_step == "on") {
+        // also finds the velocity maxima for the next calculate_dt()
+        _field.calculate_velocities_max(_grid, subdomain_part::INNER);
+        Communication::finish_exchange(_pressure_halo);
+        _field.calculate_velocities_max(_grid, subdomain_part::FRAME);
+    } else {
+        _field.calculate_velocities(_grid, subdomain_part::INNER);
+        Communication::finish_exchange(_pressure_halo);
+        _field.calculate_velocities(_grid, subdomain_part::FRAME);
+    }
+    // exchange velocities
+    Communication::communicate(_velocity_halo);
+    return err;
+}
+
+int Case::subcycle_temperatures(double temperature_dt) {
+    const int substeps = std::max(1, static_cast<int>(std::ceil(_field.dt() / temperature_dt)));
+    for (int substep = 0; substep < substeps; ++substep) {
+        for (const auto &boundary : _boundaries) {
+            boundary->apply_temperatures(_field);
+        }
+        _field.calculate_temperature_substep(_grid, substep, substeps);
+        Communication::communicate(_temperature_halo);
+    }
+    return substeps;
+}
+
+void Case::start_state_change(Reduction &change) {
+    for (const double value : _field.state_change(_grid)) {
+        change.max(value);
+    }
+    change.start();
+}
+
+double Case::state_change_rate(Reduction &change, double dt) {
+    change.finish();
+    std::array<double, 8> maxima;
+    for (int k = 0; k < 8; ++k) {
+        maxima[k] = change[k];
+    }
+    return Fields::state_change_rate(maxima, dt);
+}
+
+void Case::solve_diffusion(double (Fields::*sweep)(Grid &), HaloExchange &halo) {
+    double err = 100.0;
+    int iter_count = 0;
+    while (err > _diffusion_tolerance && iter_count < _max_iter) {
+        err = (_field.*sweep)(_grid);
+        Communication::communicate(halo);
+        err = std::sqrt(Communication::reduce_sum(err) / _fluid_cells);
+        iter_count += 1;
+    }
+}
+
 void Case::output_vtk(int timestep, int my_rank) {
     // Create a new structured grid
     vtkSmartPointer<vtkStructuredGrid> structuredGrid = vtkSmartPointer<vtkStructuredGrid>::New();
@@ -468,7 +777,9 @@ void Case::output_vtk(int timestep, int my_rank) {
 
     for (int i = 1; i <= _grid.imax(); ++i) {
         for (int j = 1; j <= _grid.jmax(); ++j) {
-            if (_grid.cell(i, j).wall_id() != 0) {
+            // walls and obstacles carry a non-zero geometry id, fluid and unassigned cells do not
+            const cell_type type = _grid.type(i, j);
+            if (type != cell_type::FLUID && type != cell_type::DEFAULT) {
                 obstacle_wall_cells.push_back(i - 1 + (j - 1) * _grid.imax());
             }
         }
@@ -537,80 +848,129 @@ void Case::output_vtk(int timestep, int my_rank) {
 
 void Case::build_domain(Domain &domain, int imax_domain, int jmax_domain) {
 
-    int I;
-    int J;
-    int imin, imax, jmin, jmax, size_x, size_y;
+    if (_decomposition == "balanced") {
+        // rank 0 reads the geometry and cuts it, the others only get the cuts
+        domain.x_cuts.resize(_iproc + 1);
+        domain.y_cuts.resize(_jproc + 1);
+        if (_process_rank == 0) {
+            Decomposition::balanced(fluid_weights(imax_domain, jmax_domain), _iproc, _jproc, domain.x_cuts,
+                                    domain.y_cuts);
+        }
+        MPI_Bcast(domain.x_cuts.data(), _iproc + 1, MPI_INT, 0, Communication::communicator());
+        MPI_Bcast(domain.y_cuts.data(), _jproc + 1, MPI_INT, 0, Communication::communicator());
+    } else {
+        domain.x_cuts = Decomposition::uniform(imax_domain, _iproc);
+        domain.y_cuts = Decomposition::uniform(jmax_domain, _jproc);
+    }
+    place_subdomain(domain);
+}
+
+void Case::place_subdomain(Domain &domain) {
+    // I is process number in x direction, J is process number in y direction
+    const int I = Communication::coordinates(_process_rank)[0];
+    const int J = Communication::coordinates(_process_rank)[1];
+    domain.imin = domain.x_cuts[I];
+    domain.imax = domain.x_cuts[I + 1] + 2;
+    domain.jmin = domain.y_cuts[J];
+    domain.jmax = domain.y_cuts[J + 1] + 2;
+    domain.size_x = domain.x_cuts[I + 1] - domain.x_cuts[I];
+    domain.size_y = domain.y_cuts[J + 1] - domain.y_cuts[J];
+
+    domain.neighbour_ranks = Communication::neighbours();
+}
+
+double Case::rebalance(double busy_time) {
+    // rank 0 decides alone, a reduction may round differently on every process
+    const std::array<double, 2> load{busy_time, static_cast<double>(_grid.fluid_cells().size())};
+    std::vector<double> loads(2 * _size);
+    MPI_Gather(load.data(), 2, MPI_DOUBLE, loads.data(), 2, MPI_DOUBLE, 0, Communication::communicator());
 
+    Domain from = domain;
+    double imbalance = 0.0;
     if (_process_rank == 0) {
-        for (int i = 1; i < _size; ++i) {
-            // I is process number in x direction, J is process number in y direction
-            I = i % _iproc + 1;
-            J = i / _iproc + 1;
-            // setting imin, imax, jmin and jmax using rank and size
-            imin = (I - 1) * (imax_domain / _iproc);
-            imax = I * (imax_domain / _iproc) + 2;
-            jmin = (J - 1) * (jmax_domain / _jproc);
-            jmax = J * (jmax_domain / _jproc) + 2;
-            size_x = imax_domain / _iproc;
-            size_y = jmax_domain / _jproc;
-
-            // Dumping extra cells in the last processor
-            if (I == _iproc) {
-                if (imax_domain % _iproc != 0) {
-                    imax = imax + (imax_domain % _iproc);
-                    size_x = size_x + (imax_domain % _iproc);
-                }
-            }
+        double max_time = 0.0;
+        double sum_time = 0.0;
+        for (int rank = 0; rank < _size; ++rank) {
+            max_time = std::max(max_time, loads[2 * rank]);
+            sum_time += loads[2 * rank];
+        }
+        imbalance = sum_time > 0.0 ? max_time * _size / sum_time : 0.0;
+    }
+    MPI_Bcast(&imbalance, 1, MPI_DOUBLE, 0, Communication::communicator());
+    if (!(imbalance > _rebalance_threshold)) {
+        return 0.0;
+    }
 
-            if (J == _jproc) {
-                if (jmax_domain % _jproc != 0) {
-                    jmax = jmax + (jmax_domain % _jproc);
-                    size_y = size_y + (jmax_domain % _jproc);
+    if (_process_rank == 0) {
+        if (_cell_weights.size() == 0) {
+            _cell_weights = fluid_weights(domain.domain_size_x, domain.domain_size_y);
+        }
+        // every fluid cell weighs the time per fluid cell of its current process
+        Matrix<double> weights = _cell_weights;
+        for (int rank = 0; rank < _size; ++rank) {
+            const double rate = loads[2 * rank] / std::max(loads[2 * rank + 1], 1.0);
+            const auto coords = Communication::coordinates(rank);
+            for (int j = from.y_cuts[coords[1]]; j < from.y_cuts[coords[1] + 1]; ++j) {
+                for (int i = from.x_cuts[coords[0]]; i < from.x_cuts[coords[0] + 1]; ++i) {
+                    weights(i, j) *= rate;
                 }
             }
-
-            // Sending domain limits to other processes
-            MPI_Send(&imin, 1, MPI_INT, i, 999, MPI_COMM_WORLD);
-            MPI_Send(&imax, 1, MPI_INT, i, 998, MPI_COMM_WORLD);
-            MPI_Send(&jmin, 1, MPI_INT, i, 997, MPI_COMM_WORLD);
-            MPI_Send(&jmax, 1, MPI_INT, i, 996, MPI_COMM_WORLD);
-            MPI_Send(&size_x, 1, MPI_INT, i, 995, MPI_COMM_WORLD);
-            MPI_Send(&size_y, 1, MPI_INT, i, 994, MPI_COMM_WORLD);
         }
-
-        I = _process_rank % _iproc + 1;
-        J = _process_rank / _iproc + 1;
-        domain.imin = (I - 1) * imax_domain / _iproc;
-        domain.imax = I * imax_domain / _iproc + 2;
-        domain.jmin = (J - 1) * jmax_domain / _jproc;
-        domain.jmax = J * jmax_domain / _jproc + 2;
-        domain.size_x = imax_domain / _iproc;
-        domain.size_y = jmax_domain / _jproc;
+        Decomposition::balanced(weights, _iproc, _jproc, domain.x_cuts, domain.y_cuts);
     }
-
-    else {
-        // Receiving domain limits from rank = 0
-        MPI_Status status;
-        MPI_Recv(&domain.imin, 1, MPI_INT, 0, 999, MPI_COMM_WORLD, &status);
-        MPI_Recv(&domain.imax, 1, MPI_INT, 0, 998, MPI_COMM_WORLD, &status);
-        MPI_Recv(&domain.jmin, 1, MPI_INT, 0, 997, MPI_COMM_WORLD, &status);
-        MPI_Recv(&domain.jmax, 1, MPI_INT, 0, 996, MPI_COMM_WORLD, &status);
-        MPI_Recv(&domain.size_x, 1, MPI_INT, 0, 995, MPI_COMM_WORLD, &status);
-        MPI_Recv(&domain.size_y, 1, MPI_INT, 0, 994, MPI_COMM_WORLD, &status);
+    MPI_Bcast(domain.x_cuts.data(), _iproc + 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(domain.y_cuts.data(), _jproc + 1, MPI_INT, 0, Communication::communicator());
+    if (domain.x_cuts == from.x_cuts && domain.y_cuts == from.y_cuts) {
+        return 0.0;
     }
+    place_subdomain(domain);
 
-    if (_process_rank + 1 < _size && (_process_rank + 1) % _iproc != 0) {
-        domain.neighbour_ranks[1] = _process_rank + 1;
-    }
-    if (_process_rank - 1 >= 0 && (_process_rank) % _iproc != 0) {
-        domain.neighbour_ranks[0] = _process_rank - 1;
+    // the halos point into the matrices that are about to be replaced
+    Communication::free_exchange(_temperature_halo);
+    Communication::free_exchange(_flux_halo);
+    Communication::free_exchange(_pressure_halo);
+    Communication::free_exchange(_velocity_halo);
+
+    _grid = Grid(_geom_name, domain, _process_rank, _size, _iproc, _jproc);
+    _field.redistribute(_grid, from);
+    fit_halo_depth();
+    build_pressure_solver();
+    build_boundaries();
+
+    Communication::init_exchange({&_field.t_matrix()}, domain, _temperature_halo);
+    Communication::init_exchange({&_field.f_matrix(), &_field.g_matrix()}, domain, _flux_halo);
+    Communication::init_exchange({&_field.p_matrix()}, domain, _pressure_halo);
+    Communication::init_exchange({&_field.u_matrix(), &_field.v_matrix()}, domain, _velocity_halo);
+    return imbalance;
+}
+
+void Case::choose_process_grid(int imax_domain, int jmax_domain) {
+    std::array<int, 2> process_grid{_size, 1};
+    if (_process_rank == 0) {
+        process_grid =
+            Decomposition::process_grid(fluid_weights(imax_domain, jmax_domain), _size, _decomposition == "balanced");
     }
-    if (_process_rank + _iproc < _size) {
-        domain.neighbour_ranks[3] = _process_rank + _iproc;
+    MPI_Bcast(process_grid.data(), 2, MPI_INT, 0, Communication::communicator());
+    _iproc = process_grid[0];
+    _jproc = process_grid[1];
+}
+
+Matrix<double> Case::fluid_weights(int imax_domain, int jmax_domain) const {
+    // the lid driven cavity is fluid everywhere
+    if (_geom_name.compare("NONE") == 0) {
+        return Matrix<double>(imax_domain, jmax_domain, 1.0);
     }
-    if (_process_rank - _iproc >= 0) {
-        domain.neighbour_ranks[2] = _process_rank - _iproc;
+    const std::vector<std::vector<int>> geometry =
+        Grid::read_geometry(_geom_name, domain, 0, imax_domain + 2, 0, jmax_domain + 2);
+    Matrix<double> weights(imax_domain, jmax_domain, 0.0);
+    for (int j = 0; j < jmax_domain; ++j) {
+        for (int i = 0; i < imax_domain; ++i) {
+            if (geometry[i + 1][j + 1] == 0) {
+                weights(i, j) = 1.0;
+            }
+        }
     }
+    return weights;
 }
 
 void Case::output_log(std::string dat_file_name, double nu, double UI, double VI, double PI, double GX, double GY,
@@ -641,10 +1001,32 @@ void Case::output_log(std::string dat_file_name, double nu, double UI, double VI
     output << "GY : " << GY << "\n";
     output << "PI : " << PI << "\n";
     output << "itermax : " << itermax << "\n";
+    output << "SIMD kernels : " << SimdKernels::name(_simd_isa) << "\n";
+    output << "Fused time step : " << _fused_step << "\n";
+    output << "Diffusion : " << _diffusion << "\n";
+    output << "Pressure boundaries : " << _pressure_bc << "\n";
+    if (_steady_tolerance > 0.0) {
+        output << "Steady state tolerance : " << _steady_tolerance << "\n";
+        output << "Steady state window : " << _steady_window << "\n";
+    }
+    if (_diffusion == "implicit") {
+        output << "Diffusion tolerance : " << _diffusion_tolerance << "\n";
+    }
+    output << "Time integrator : " << _time_integrator << "\n";
+    output << "Energy subcycling : " << _energy_subcycling << "\n";
     output << "Energy Equation : " << _energy_eq << "\n";
     output << "Number of processes in x-direction : " << _iproc << "\n";
     output << "Number of processes in y-direction : " << _jproc << "\n";
+    output << "Process grid : " << (_auto_process_grid ? "auto" : "input") << "\n";
+    output << "Decomposition : " << _decomposition << "\n";
+    output << "Halo exchange : " << _halo_exchange << "\n";
+    output << "Halo depth : " << _halo_depth << "\n";
+    if (_rebalance_interval > 0) {
+        output << "Rebalance interval : " << _rebalance_interval << "\n";
+        output << "Rebalance threshold : " << _rebalance_threshold << "\n";
+    }
     output << "Total number of process : " << _size << "\n";
+    output << "Threads per process : " << Threading::num_threads() << "\n";
     if (_energy_eq == "on") {
         output << "Temp Initial : " << TI << "\n";
         output << "alpha : " << alpha << "\n";
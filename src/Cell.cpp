@@ -13,11 +13,8 @@ const Cell *Cell::neighbour(border_position position) const { return _neighbours
 
 void Cell::set_neighbour(Cell *cell, border_position position) { _neighbours.at(static_cast<int>(position)) = cell; }
 
-const std::vector<border_position> &Cell::borders() const { return _borders; }
-
 void Cell::add_border(border_position border) {
     _border.at(static_cast<int>(border)) = true;
-    _borders.push_back(border);
 }
 
 int Cell::i() const { return _i; }
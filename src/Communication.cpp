@@ -1,86 +1,513 @@
 #include "Communication.hpp"
 #include <mpi.h>
 
+#include <algorithm>
+#include <utility>
+
+namespace {
+// operation codes of the Reduction entries
+constexpr double reduce_sum_op = 0.0;
+constexpr double reduce_min_op = 1.0;
+constexpr double reduce_max_op = 2.0;
+
+// one Reduction entry on the wire and the operation combining entries of any kind
+MPI_Datatype entry_type = MPI_DATATYPE_NULL;
+MPI_Op entry_op = MPI_OP_NULL;
+
+void combine_entries(void *in, void *inout, int *len, MPI_Datatype *) {
+    const auto *a = static_cast<const Reduction::Entry *>(in);
+    auto *b = static_cast<Reduction::Entry *>(inout);
+    for (int k = 0; k < *len; ++k) {
+        if (b[k].operation == reduce_sum_op) {
+            b[k].value = a[k].value + b[k].value;
+        } else if (b[k].operation == reduce_min_op) {
+            b[k].value = std::min(a[k].value, b[k].value);
+        } else {
+            b[k].value = std::max(a[k].value, b[k].value);
+        }
+    }
+}
+
+// tags of the messages towards the left, right, bottom and top neighbour
+constexpr std::array<int, 4> send_tags{1000, 1001, 1002, 1003};
+// a message from a neighbour travels in the opposite direction
+constexpr std::array<int, 4> receive_tags{1001, 1000, 1003, 1002};
+
+// processes arranged by create_topology()
+MPI_Comm topology = MPI_COMM_WORLD;
+// processes of the topology that share the node of this one, MPI_COMM_NULL without shared memory halos
+MPI_Comm node = MPI_COMM_NULL;
+
+// seconds spent in blocking waits, see Communication::wait_time()
+double waited = 0.0;
+
+/// adds the time from its construction until it goes out of scope to waited
+class WaitClock {
+  public:
+    WaitClock() : _start(MPI_Wtime()) {}
+    ~WaitClock() { waited += MPI_Wtime() - _start; }
+
+  private:
+    double _start;
+};
+
+/// MPI_Waitall that counts as waiting
+void wait_all(int count, MPI_Request *requests) {
+    WaitClock clock;
+    MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+}
+
+/// cells [i_begin, i_end) x [j_begin, j_end) of the whole domain, ghost layer included
+struct Block {
+    int i_begin;
+    int i_end;
+    int j_begin;
+    int j_end;
+
+    int cells() const { return std::max(0, i_end - i_begin) * std::max(0, j_end - j_begin); }
+};
+
+Block intersection(const Block &a, const Block &b) {
+    return Block{std::max(a.i_begin, b.i_begin), std::min(a.i_end, b.i_end), std::max(a.j_begin, b.j_begin),
+                 std::min(a.j_end, b.j_end)};
+}
+
+/// cells of the subdomain of a process, plus the outer boundary of the domain next to it
+Block owned_block(const Domain &domain, int rank) {
+    const auto coords = Communication::coordinates(rank);
+    const int I = coords[0];
+    const int J = coords[1];
+    const bool last_column = I + 2 == static_cast<int>(domain.x_cuts.size());
+    const bool last_row = J + 2 == static_cast<int>(domain.y_cuts.size());
+    return Block{I == 0 ? 0 : domain.x_cuts[I] + 1, last_column ? domain.domain_size_x + 2 : domain.x_cuts[I + 1] + 1,
+                 J == 0 ? 0 : domain.y_cuts[J] + 1, last_row ? domain.domain_size_y + 2 : domain.y_cuts[J + 1] + 1};
+}
+
+/// cells of the matrices of a process, ghost layers included
+Block matrix_block(const Domain &domain, int rank) {
+    const auto coords = Communication::coordinates(rank);
+    return Block{domain.x_cuts[coords[0]], domain.x_cuts[coords[0] + 1] + 2, domain.y_cuts[coords[1]],
+                 domain.y_cuts[coords[1] + 1] + 2};
+}
+
+/// side of the neighbour that faces the given side of this process
+int opposite(int side) { return side ^ 1; }
+
+/// rank in the node communicator of a process of the topology, MPI_UNDEFINED if it is on another node
+int node_rank(int rank) {
+    MPI_Group topology_group, node_group;
+    MPI_Comm_group(topology, &topology_group);
+    MPI_Comm_group(node, &node_group);
+    int translated;
+    MPI_Group_translate_ranks(topology_group, 1, &rank, node_group, &translated);
+    MPI_Group_free(&topology_group);
+    MPI_Group_free(&node_group);
+    return translated;
+}
+
+/// first of the interior lines of a side that are sent to the neighbour there, and of the ghost lines they fill
+int interior_line(const Domain &domain, int side, int width) {
+    switch (side) {
+    case 0:
+    case 2:
+        return width;
+    case 1:
+        return domain.size_x;
+    default:
+        return domain.size_y;
+    }
+}
+
+int ghost_line(const Domain &domain, int side, int width) {
+    switch (side) {
+    case 0:
+    case 2:
+        return 0;
+    case 1:
+        return domain.size_x + width;
+    default:
+        return domain.size_y + width;
+    }
+}
+
+/// number of values one matrix contributes to the messages of a side
+int strip_size(const Matrix<double> &matrix, int side, int width) {
+    return width * (side < 2 ? matrix.jmax() : matrix.imax());
+}
+
+/// number of values all matrices contribute to the messages of a side
+std::size_t side_size(const HaloExchange &halo, int side) {
+    std::size_t size = 0;
+    for (const auto *matrix : halo.matrices) {
+        size += strip_size(*matrix, side, halo.width);
+    }
+    return size;
+}
+
+/// packs the interior lines of all matrices next to the given side and sends them
+void send_side(HaloExchange &halo, int side) {
+    auto *buffer = halo.shared[side] ? halo.outbox[side] + halo.turn * side_size(halo, side) : halo.send[side].data();
+    const int first = interior_line(*halo.domain, side, halo.width);
+    for (const auto *matrix : halo.matrices) {
+        const int n = side < 2 ? matrix->jmax() : matrix->imax();
+        for (int line = first; line < first + halo.width; ++line) {
+            for (int k = 0; k < n; ++k) {
+                *buffer++ = side < 2 ? (*matrix)(line, k) : (*matrix)(k, line);
+            }
+        }
+    }
+    if (halo.shared[side]) {
+        // the strip has to be visible before the empty message tells the neighbour so
+        MPI_Win_sync(halo.windows[side]);
+    }
+    MPI_Start(&halo.requests[4 + side]);
+}
+
+/// copies the received lines of the given side into the ghost lines of all matrices
+void unpack_side(HaloExchange &halo, int side) {
+    const double *buffer = halo.receive[side].data();
+    if (halo.shared[side]) {
+        MPI_Win_sync(halo.windows[opposite(side)]);
+        buffer = halo.inbox[side] + halo.turn * side_size(halo, side);
+    }
+    const int first = ghost_line(*halo.domain, side, halo.width);
+    for (auto *matrix : halo.matrices) {
+        const int n = side < 2 ? matrix->jmax() : matrix->imax();
+        for (int line = first; line < first + halo.width; ++line) {
+            for (int k = 0; k < n; ++k) {
+                (side < 2 ? (*matrix)(line, k) : (*matrix)(k, line)) = *buffer++;
+            }
+        }
+    }
+}
+
+/// allocates the shared windows of all sides and looks up the strips of the neighbours on the node
+void init_windows(HaloExchange &halo) {
+    MPI_Info info;
+    MPI_Info_create(&info);
+    // each process keeps its strips in its own memory
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    std::array<int, 4> neighbours{MPI_UNDEFINED, MPI_UNDEFINED, MPI_UNDEFINED, MPI_UNDEFINED};
+    for (int side = 0; side < 4; ++side) {
+        if (halo.domain->neighbour_ranks[side] != -1) {
+            neighbours[side] = node_rank(halo.domain->neighbour_ranks[side]);
+        }
+        halo.shared[side] = (neighbours[side] != MPI_UNDEFINED);
+        // every process of the node takes part, with an empty window without shared neighbour
+        const std::size_t size = halo.shared[side] ? 2 * side_size(halo, side) : 0;
+        MPI_Win_allocate_shared(static_cast<MPI_Aint>(size * sizeof(double)), sizeof(double), info, node,
+                                &halo.outbox[side], &halo.windows[side]);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, halo.windows[side]);
+    }
+    MPI_Info_free(&info);
+
+    for (int side = 0; side < 4; ++side) {
+        if (halo.shared[side]) {
+            MPI_Aint size;
+            int disp_unit;
+            double *strips;
+            MPI_Win_shared_query(halo.windows[opposite(side)], neighbours[side], &size, &disp_unit, &strips);
+            halo.inbox[side] = strips;
+        }
+    }
+}
+} // namespace
+
 void Communication::init_parallel(int *argn, char **args, int &rank, int &size) {
-    MPI_Init(argn, &args);
+    // threads never call MPI, the halo exchange happens outside the parallel regions
+    int provided;
+    MPI_Init_thread(argn, &args, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    MPI_Type_contiguous(2, MPI_DOUBLE, &entry_type);
+    MPI_Type_commit(&entry_type);
+    MPI_Op_create(&combine_entries, 1, &entry_op);
+}
+
+void Communication::create_topology(int iproc, int jproc, int &rank, bool shared_memory) {
+    // y first, so that ranks run fastest in x direction like the subdomain numbering
+    std::array<int, 2> dims{jproc, iproc};
+    std::array<int, 2> periods{0, 0};
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims.data(), periods.data(), 1, &topology);
+    MPI_Comm_rank(topology, &rank);
+
+    if (shared_memory) {
+        MPI_Comm_split_type(topology, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+        int node_size;
+        MPI_Comm_size(node, &node_size);
+        // a process alone on its node has nobody to share with
+        if (node_size == 1) {
+            MPI_Comm_free(&node);
+        }
+    }
+}
+
+MPI_Comm Communication::communicator() { return topology; }
+
+std::array<int, 2> Communication::coordinates(int rank) {
+    std::array<int, 2> coords{0, 0};
+    if (topology != MPI_COMM_WORLD) {
+        MPI_Cart_coords(topology, rank, 2, coords.data());
+    }
+    return {coords[1], coords[0]};
+}
+
+std::array<int, 4> Communication::neighbours() {
+    std::array<int, 4> ranks{-1, -1, -1, -1};
+    if (topology == MPI_COMM_WORLD) {
+        return ranks;
+    }
+    MPI_Cart_shift(topology, 1, 1, &ranks[0], &ranks[1]);
+    MPI_Cart_shift(topology, 0, 1, &ranks[2], &ranks[3]);
+    for (auto &rank : ranks) {
+        if (rank == MPI_PROC_NULL) {
+            rank = -1;
+        }
+    }
+    return ranks;
 }
 
 double Communication::reduce_min(double dt) {
     double reduced_dt;
 
-    MPI_Reduce(&dt, &reduced_dt, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&reduced_dt, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    WaitClock clock;
+    MPI_Allreduce(&dt, &reduced_dt, 1, MPI_DOUBLE, MPI_MIN, topology);
     return reduced_dt;
 }
 
-void Communication::finalize() { MPI_Finalize(); }
+double Communication::reduce_max(double value) {
+    double reduced_value;
+
+    WaitClock clock;
+    MPI_Allreduce(&value, &reduced_value, 1, MPI_DOUBLE, MPI_MAX, topology);
+    return reduced_value;
+}
+
+void Communication::finalize() {
+    if (entry_op != MPI_OP_NULL) {
+        MPI_Op_free(&entry_op);
+        MPI_Type_free(&entry_type);
+    }
+    if (node != MPI_COMM_NULL) {
+        MPI_Comm_free(&node);
+    }
+    if (topology != MPI_COMM_WORLD) {
+        MPI_Comm_free(&topology);
+    }
+    MPI_Finalize();
+}
 
 void Communication::abort() { MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE); }
 
 double Communication::reduce_sum(double res) {
     double reduced_res;
 
-    MPI_Reduce(&res, &reduced_res, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&reduced_res, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    WaitClock clock;
+    MPI_Allreduce(&res, &reduced_res, 1, MPI_DOUBLE, MPI_SUM, topology);
 
     return reduced_res;
 }
 
-void Communication::communicate(Matrix<double> &matrix, const Domain &domain) {
+int Reduction::add(double operation, double value) {
+    _entries.push_back(Entry{operation, value});
+    return static_cast<int>(_entries.size()) - 1;
+}
+
+int Reduction::sum(double value) { return add(reduce_sum_op, value); }
+
+int Reduction::min(double value) { return add(reduce_min_op, value); }
+
+int Reduction::max(double value) { return add(reduce_max_op, value); }
+
+void Reduction::reduce() {
+    _results.resize(_entries.size());
+    WaitClock clock;
+    MPI_Allreduce(_entries.data(), _results.data(), static_cast<int>(_entries.size()), entry_type, entry_op,
+                  topology);
+    _entries.swap(_results);
+}
+
+void Reduction::start() {
+    _results.resize(_entries.size());
+    MPI_Iallreduce(_entries.data(), _results.data(), static_cast<int>(_entries.size()), entry_type, entry_op,
+                   topology, &_request);
+}
+
+void Reduction::finish() {
+    wait_all(1, &_request);
+    _entries.swap(_results);
+}
 
-    std::vector<double> sender;
+HaloExchange::~HaloExchange() {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (!finalized) {
+        Communication::free_exchange(*this);
+    }
+}
 
-    // sending and recieving with left neighbour
+void Communication::communicate(HaloExchange &halo) {
+    start_exchange(halo);
+    finish_exchange(halo);
+}
 
-    if (domain.neighbour_ranks[0] != -1) {
+void Communication::init_exchange(std::initializer_list<Matrix<double> *> matrices, const Domain &domain,
+                                  HaloExchange &halo, int width) {
+    finish_exchange(halo);
+    free_exchange(halo);
+    halo.matrices.assign(matrices.begin(), matrices.end());
+    halo.domain = &domain;
+    halo.width = width;
 
-        sender = matrix.get_col(1); // skipping one level to get the first fluid level without buffer
-        std::vector<double> receiver(sender.size());
+    if (node != MPI_COMM_NULL) {
+        init_windows(halo);
+    }
 
-        MPI_Send(&sender[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[0], 1000, MPI_COMM_WORLD);
-        MPI_Status status;
+    for (int side = 0; side < 4; ++side) {
+        if (domain.neighbour_ranks[side] == -1) {
+            continue;
+        }
+        if (halo.shared[side]) {
+            // the strips are read from shared memory, the messages only tell that they are ready
+            MPI_Recv_init(nullptr, 0, MPI_DOUBLE, domain.neighbour_ranks[side], receive_tags[side], topology,
+                          &halo.requests[side]);
+            MPI_Send_init(nullptr, 0, MPI_DOUBLE, domain.neighbour_ranks[side], send_tags[side], topology,
+                          &halo.requests[4 + side]);
+            continue;
+        }
+        const std::size_t size = side_size(halo, side);
+        halo.receive[side].resize(size);
+        halo.send[side].resize(size);
+        MPI_Recv_init(halo.receive[side].data(), static_cast<int>(size), MPI_DOUBLE, domain.neighbour_ranks[side],
+                      receive_tags[side], topology, &halo.requests[side]);
+        MPI_Send_init(halo.send[side].data(), static_cast<int>(size), MPI_DOUBLE, domain.neighbour_ranks[side],
+                      send_tags[side], topology, &halo.requests[4 + side]);
+    }
+}
 
-        MPI_Recv(&receiver[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[0], 1001, MPI_COMM_WORLD, &status);
+void Communication::start_exchange(HaloExchange &halo) {
+    const Domain &domain = *halo.domain;
+    halo.in_flight = true;
 
-        matrix.set_col(receiver, 0);
+    // all receives are posted first, so no message has to wait for its counterpart
+    for (int side = 0; side < 4; ++side) {
+        if (domain.neighbour_ranks[side] != -1) {
+            MPI_Start(&halo.requests[side]);
+        }
     }
-    // sending and recieving with right neighbour
 
-    if (domain.neighbour_ranks[1] != -1) {
+    // skipping one level to get the first fluid level without buffer
+    for (int side = 0; side < 2; ++side) {
+        if (domain.neighbour_ranks[side] != -1) {
+            send_side(halo, side);
+        }
+    }
+}
 
-        sender = matrix.get_col(domain.size_x); // skipping one level to get the first fluid level without buffer
-        std::vector<double> receiver(sender.size());
-        MPI_Status status;
-        MPI_Recv(&receiver[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[1], 1000, MPI_COMM_WORLD, &status);
+void Communication::finish_exchange(HaloExchange &halo) {
+    if (!halo.active()) {
+        return;
+    }
+    const Domain &domain = *halo.domain;
 
-        MPI_Send(&sender[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[1], 1001, MPI_COMM_WORLD);
-        matrix.set_col(receiver, domain.size_x + 1);
+    wait_all(2, halo.requests.data());
+    for (int side = 0; side < 2; ++side) {
+        if (domain.neighbour_ranks[side] != -1) {
+            unpack_side(halo, side);
+        }
     }
 
-    // sending and recieving with bottom neighbour
-    if (domain.neighbour_ranks[2] != -1) {
+    // the rows include the ghost columns just received, which fills the corners
+    for (int side = 2; side < 4; ++side) {
+        if (domain.neighbour_ranks[side] != -1) {
+            send_side(halo, side);
+        }
+    }
+    wait_all(2, halo.requests.data() + 2);
+    for (int side = 2; side < 4; ++side) {
+        if (domain.neighbour_ranks[side] != -1) {
+            unpack_side(halo, side);
+        }
+    }
 
-        sender = matrix.get_row(1);
-        std::vector<double> receiver(sender.size());
+    // the send buffers may only be reused once the sends are done
+    wait_all(4, halo.requests.data() + 4);
+    halo.in_flight = false;
+    // the neighbours may still read this turn's shared strips, the next exchange writes the other ones
+    halo.turn = 1 - halo.turn;
+}
 
-        MPI_Send(&sender[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[2], 1002, MPI_COMM_WORLD);
-        MPI_Status status;
-        MPI_Recv(&receiver[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[2], 1003, MPI_COMM_WORLD, &status);
-        matrix.set_row(receiver, 0);
+void Communication::free_exchange(HaloExchange &halo) {
+    for (auto &request : halo.requests) {
+        if (request != MPI_REQUEST_NULL) {
+            MPI_Request_free(&request);
+        }
     }
+    for (int side = 0; side < 4; ++side) {
+        if (halo.windows[side] != MPI_WIN_NULL) {
+            MPI_Win_unlock_all(halo.windows[side]);
+            MPI_Win_free(&halo.windows[side]);
+        }
+        halo.shared[side] = false;
+        halo.outbox[side] = nullptr;
+        halo.inbox[side] = nullptr;
+    }
+    halo.turn = 0;
+}
 
-    // sending and recieving with top neighbour
-    if (domain.neighbour_ranks[3] != -1) {
+void Communication::migrate(const std::vector<Matrix<double> *> &matrices, const Domain &from, const Domain &to) {
+    int rank, size;
+    MPI_Comm_rank(topology, &rank);
+    MPI_Comm_size(topology, &size);
+    const Block owned = owned_block(from, rank);
+    const Block needed = matrix_block(to, rank);
 
-        sender = matrix.get_row(domain.size_y);
-        std::vector<double> receiver(sender.size());
-        MPI_Status status;
-        MPI_Recv(&receiver[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[3], 1002, MPI_COMM_WORLD, &status);
+    // the cells of a block go matrix by matrix, row by row
+    std::vector<int> send_counts(size), send_offsets(size), receive_counts(size), receive_offsets(size);
+    std::vector<double> send_buffer;
+    int received = 0;
+    for (int other = 0; other < size; ++other) {
+        const Block block = intersection(owned, matrix_block(to, other));
+        send_offsets[other] = static_cast<int>(send_buffer.size());
+        if (block.cells() > 0) {
+            for (const auto *matrix : matrices) {
+                for (int j = block.j_begin; j < block.j_end; ++j) {
+                    for (int i = block.i_begin; i < block.i_end; ++i) {
+                        send_buffer.push_back((*matrix)(i - from.imin, j - from.jmin));
+                    }
+                }
+            }
+        }
+        send_counts[other] = static_cast<int>(send_buffer.size()) - send_offsets[other];
+        receive_offsets[other] = received;
+        receive_counts[other] =
+            intersection(owned_block(from, other), needed).cells() * static_cast<int>(matrices.size());
+        received += receive_counts[other];
+    }
 
-        MPI_Send(&sender[0], sender.size(), MPI_DOUBLE, domain.neighbour_ranks[3], 1003, MPI_COMM_WORLD);
+    std::vector<double> receive_buffer(received);
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_offsets.data(), MPI_DOUBLE, receive_buffer.data(),
+                  receive_counts.data(), receive_offsets.data(), MPI_DOUBLE, topology);
 
-        matrix.set_row(receiver, domain.size_y + 1);
+    std::vector<Matrix<double>> moved(matrices.size(), Matrix<double>(to.size_x + 2, to.size_y + 2, 0.0));
+    const double *buffer = receive_buffer.data();
+    for (int other = 0; other < size; ++other) {
+        const Block block = intersection(owned_block(from, other), needed);
+        if (block.cells() == 0) {
+            continue;
+        }
+        for (auto &matrix : moved) {
+            for (int j = block.j_begin; j < block.j_end; ++j) {
+                for (int i = block.i_begin; i < block.i_end; ++i) {
+                    matrix(i - to.imin, j - to.jmin) = *buffer++;
+                }
+            }
+        }
     }
-}
\ No newline at end of file
+    for (std::size_t k = 0; k < matrices.size(); ++k) {
+        *matrices[k] = std::move(moved[k]);
+    }
+}
+
+double Communication::wait_time() { return waited; }
@@ -0,0 +1,179 @@
+#include "Decomposition.hpp"
+
+#include <algorithm>
+
+namespace {
+/// sums of the weights over all blocks [i_begin, i_end) x [j_begin, j_end) in constant time
+class WorkSums {
+  public:
+    explicit WorkSums(const Matrix<double> &weights) : _sums(weights.imax() + 1, weights.jmax() + 1, 0.0) {
+        for (int j = 0; j < weights.jmax(); ++j) {
+            for (int i = 0; i < weights.imax(); ++i) {
+                _sums(i + 1, j + 1) = weights(i, j) + _sums(i, j + 1) + _sums(i + 1, j) - _sums(i, j);
+            }
+        }
+    }
+
+    double block(int i_begin, int i_end, int j_begin, int j_end) const {
+        return _sums(i_end, j_end) - _sums(i_begin, j_end) - _sums(i_end, j_begin) + _sums(i_begin, j_begin);
+    }
+
+  private:
+    Matrix<double> _sums;
+};
+
+/**
+ * Greedy cuts of [0, cells) into parts bands whose work stays below limit,
+ * empty if there are none. band_work(begin, end) is the work of a band.
+ */
+template <typename BandWork>
+std::vector<int> cuts_within(int cells, int parts, double limit, const BandWork &band_work) {
+    std::vector<int> cuts{0};
+    int begin = 0;
+    for (int k = 0; k < parts - 1; ++k) {
+        // every later part keeps at least one cell
+        const int last_end = cells - (parts - k - 1);
+        int end = begin + 1;
+        if (band_work(begin, end) > limit) {
+            return {};
+        }
+        while (end < last_end && band_work(begin, end + 1) <= limit) {
+            ++end;
+        }
+        cuts.push_back(end);
+        begin = end;
+    }
+    if (band_work(begin, cells) > limit) {
+        return {};
+    }
+    cuts.push_back(cells);
+    return cuts;
+}
+
+/// cuts of [0, cells) into parts bands with the smallest possible largest band work
+template <typename BandWork> std::vector<int> balanced_cuts(int cells, int parts, double total, const BandWork &band_work) {
+    double feasible = total;
+    double infeasible = 0.0;
+    for (int k = 0; k < 64 && feasible - infeasible > 1e-9 * total; ++k) {
+        const double limit = 0.5 * (feasible + infeasible);
+        if (cuts_within(cells, parts, limit, band_work).empty()) {
+            infeasible = limit;
+        } else {
+            feasible = limit;
+        }
+    }
+    return cuts_within(cells, parts, feasible, band_work);
+}
+} // namespace
+
+std::vector<int> Decomposition::uniform(int cells, int parts) {
+    std::vector<int> cuts(parts + 1);
+    for (int k = 0; k < parts; ++k) {
+        cuts[k] = k * (cells / parts);
+    }
+    // Dumping extra cells in the last processor
+    cuts[parts] = cells;
+    return cuts;
+}
+
+void Decomposition::balanced(const Matrix<double> &weights, int iproc, int jproc, std::vector<int> &x_cuts,
+                             std::vector<int> &y_cuts) {
+    const int nx = weights.imax();
+    const int ny = weights.jmax();
+    const WorkSums sums(weights);
+    const double total = sums.block(0, nx, 0, ny);
+    x_cuts = uniform(nx, iproc);
+    y_cuts = uniform(ny, jproc);
+    if (total <= 0.0) {
+        return;
+    }
+
+    auto cut_x = [&](const std::vector<int> &y) {
+        return balanced_cuts(nx, iproc, total, [&](int begin, int end) {
+            double work = 0.0;
+            for (std::size_t k = 0; k + 1 < y.size(); ++k) {
+                work = std::max(work, sums.block(begin, end, y[k], y[k + 1]));
+            }
+            return work;
+        });
+    };
+    auto cut_y = [&](const std::vector<int> &x) {
+        return balanced_cuts(ny, jproc, total, [&](int begin, int end) {
+            double work = 0.0;
+            for (std::size_t k = 0; k + 1 < x.size(); ++k) {
+                work = std::max(work, sums.block(x[k], x[k + 1], begin, end));
+            }
+            return work;
+        });
+    };
+
+    // start from columns balanced over the whole height
+    std::vector<int> x = cut_x({0, ny});
+    std::vector<int> y = cut_y(x);
+    double best = max_work(weights, x, y);
+    x_cuts = x;
+    y_cuts = y;
+    for (int round = 0; round < 8; ++round) {
+        x = cut_x(y_cuts);
+        y = cut_y(x);
+        const double work = max_work(weights, x, y);
+        if (work >= best) {
+            break;
+        }
+        best = work;
+        x_cuts = x;
+        y_cuts = y;
+    }
+}
+
+double Decomposition::max_work(const Matrix<double> &weights, const std::vector<int> &x_cuts,
+                               const std::vector<int> &y_cuts) {
+    const WorkSums sums(weights);
+    double work = 0.0;
+    for (std::size_t J = 0; J + 1 < y_cuts.size(); ++J) {
+        for (std::size_t I = 0; I + 1 < x_cuts.size(); ++I) {
+            work = std::max(work, sums.block(x_cuts[I], x_cuts[I + 1], y_cuts[J], y_cuts[J + 1]));
+        }
+    }
+    return work;
+}
+
+std::array<int, 2> Decomposition::process_grid(const Matrix<double> &weights, int size, bool balanced) {
+    const int nx = weights.imax();
+    const int ny = weights.jmax();
+    const WorkSums sums(weights);
+    std::array<int, 2> best{size, 1};
+    double best_cost = -1.0;
+    double best_halo = 0.0;
+    for (int iproc = 1; iproc <= size; ++iproc) {
+        const int jproc = size / iproc;
+        if (iproc * jproc != size || iproc > nx || jproc > ny) {
+            continue;
+        }
+        std::vector<int> x_cuts = uniform(nx, iproc);
+        std::vector<int> y_cuts = uniform(ny, jproc);
+        if (balanced) {
+            Decomposition::balanced(weights, iproc, jproc, x_cuts, y_cuts);
+        }
+
+        double cost = 0.0;
+        double total_halo = 0.0;
+        for (int J = 0; J < jproc; ++J) {
+            for (int I = 0; I < iproc; ++I) {
+                const int size_x = x_cuts[I + 1] - x_cuts[I];
+                const int size_y = y_cuts[J + 1] - y_cuts[J];
+                // a halo line towards every neighbour
+                const double halo = ((I > 0) + (I < iproc - 1)) * size_y + ((J > 0) + (J < jproc - 1)) * size_x;
+                const double work = sums.block(x_cuts[I], x_cuts[I + 1], y_cuts[J], y_cuts[J + 1]);
+                cost = std::max(cost, work + halo);
+                total_halo += halo;
+            }
+        }
+        if (best_cost < 0.0 || cost < best_cost || (cost == best_cost && total_halo < best_halo)) {
+            best = {iproc, jproc};
+            best_cost = cost;
+            best_halo = total_halo;
+        }
+    }
+    return best;
+}
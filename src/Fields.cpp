@@ -2,8 +2,19 @@
 #include "Communication.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
+#include <limits>
+
+namespace {
+/// combines partial maxima of Grid::reduce_fluid_spans()
+double max_of(double a, double b) { return std::max(a, b); }
+/// raises a maximum, a NaN counts as infinity so that the following maxima keep it
+void raise_max(double &maximum, double value) {
+    maximum = std::isnan(value) ? std::numeric_limits<double>::infinity() : std::max(maximum, value);
+}
+} // namespace
 
 Fields::Fields(Grid &grid, double nu, double dt, double tau, double alpha, double beta, std::string energy_eq, int imax,
                int jmax, double UI, double VI, double PI, double TI, double gx, double gy, int process_rank, int size)
@@ -11,6 +22,8 @@ Fields::Fields(Grid &grid, double nu, double dt, double tau, double alpha, doubl
 
     _process_rank = process_rank;
     _size = size;
+    _explicit_nu = nu;
+    _explicit_alpha = alpha;
 
     _U = Matrix<double>(imax + 2, jmax + 2);
     _V = Matrix<double>(imax + 2, jmax + 2);
@@ -33,154 +46,646 @@ Fields::Fields(Grid &grid, double nu, double dt, double tau, double alpha, doubl
     _F = Matrix<double>(imax + 2, jmax + 2, 0.0);
     _G = Matrix<double>(imax + 2, jmax + 2, 0.0);
     _RS = Matrix<double>(imax + 2, jmax + 2, 0.0);
+
+    if (_energy_eq != "on" && _energy_eq != "off") {
+        std::cout << "Something went wrong with energy equation on and off\nPlease check\n";
+        Communication::abort();
+    }
+    _energy_on = (_energy_eq == "on");
+
+    compile_boundary_fluxes(grid);
+
+    // general kernels until the discretization is known, see select_kernels()
+    assign_kernels<upwind_scheme::HYBRID, false>();
+}
+
+void Fields::select_kernels(const Discretization &discretization, simd_isa isa) {
+    if (isa != simd_isa::SCALAR) {
+        _flux_row = SimdKernels::flux_row(isa, _energy_on);
+        _temperature_row = SimdKernels::temperature_row(isa);
+        if (_flux_row != nullptr && _temperature_row != nullptr) {
+            _flux_kernel = &Fields::flux_kernel_rows;
+            _temperature_kernel = &Fields::temperature_kernel_rows;
+            return;
+        }
+    }
+
+    const bool uniform = discretization.uniform();
+    switch (discretization.scheme()) {
+    case upwind_scheme::CENTRAL:
+        uniform ? assign_kernels<upwind_scheme::CENTRAL, true>() : assign_kernels<upwind_scheme::CENTRAL, false>();
+        break;
+    case upwind_scheme::DONOR_CELL:
+        uniform ? assign_kernels<upwind_scheme::DONOR_CELL, true>()
+                : assign_kernels<upwind_scheme::DONOR_CELL, false>();
+        break;
+    default:
+        uniform ? assign_kernels<upwind_scheme::HYBRID, true>() : assign_kernels<upwind_scheme::HYBRID, false>();
+        break;
+    }
+}
+
+template <upwind_scheme Scheme, bool Uniform> void Fields::assign_kernels() {
+    if (_energy_on) {
+        _flux_kernel = &Fields::flux_kernel<true, Scheme, Uniform>;
+    } else {
+        _flux_kernel = &Fields::flux_kernel<false, Scheme, Uniform>;
+    }
+    _temperature_kernel = &Fields::temperature_kernel<Scheme, Uniform>;
+}
+
+template <bool Energy, upwind_scheme Scheme, bool Uniform> void Fields::flux_kernel(int j, int i_begin, int i_end) {
+    const Stencil s = Discretization::stencil();
+
+    for (int i = i_begin; i < i_end; ++i) {
+        double f_rhs = _explicit_nu * Discretization::laplacian<Uniform>(_U, i, j, s) -
+                       Discretization::convection_u<Scheme, Uniform>(_U, _V, i, j, s);
+        double g_rhs = _explicit_nu * Discretization::laplacian<Uniform>(_V, i, j, s) -
+                       Discretization::convection_v<Scheme, Uniform>(_U, _V, i, j, s);
+        if constexpr (Energy) {
+            _F(i, j) = _U(i, j) + _dt * f_rhs - 0.5 * _dt * _beta * (_T(i, j) + _T(i + 1, j)) * _gx;
+            _G(i, j) = _V(i, j) + _dt * g_rhs - 0.5 * _dt * _beta * (_T(i, j) + _T(i, j + 1)) * _gy;
+        } else {
+            _F(i, j) = _U(i, j) + _dt * (f_rhs + _gx);
+            _G(i, j) = _V(i, j) + _dt * (g_rhs + _gy);
+        }
+    }
+}
+
+template <upwind_scheme Scheme, bool Uniform> void Fields::temperature_kernel(Grid &grid) {
+    const Stencil s = Discretization::stencil();
+
+    grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        for (int i = i_begin; i < i_end; ++i) {
+            _T_new(i, j) = _T(i, j) + _dt * (_explicit_alpha * Discretization::laplacian<Uniform>(_T, i, j, s) -
+                                             Discretization::convection_t<Scheme, Uniform>(_T, _U, _V, i, j, s));
+        }
+    });
+}
+
+RowKernelParams Fields::row_kernel_params() const {
+    const Stencil &s = Discretization::stencil();
+    RowKernelParams params;
+    params.dt = _dt;
+    params.nu = _explicit_nu;
+    params.alpha = _explicit_alpha;
+    params.beta = _beta;
+    params.gamma = s.gamma;
+    params.gx = _gx;
+    params.gy = _gy;
+    params.inv_dx = s.inv_dx;
+    params.inv_dy = s.inv_dy;
+    params.inv_dx2 = s.inv_dx2;
+    params.inv_dy2 = s.inv_dy2;
+    return params;
+}
+
+void Fields::flux_kernel_rows(int j, int i_begin, int i_end) {
+    const int stride = _U.imax();
+    const int row = stride * j;
+    _flux_row(_U.data() + row, _V.data() + row, _T.data() + row, _F.data() + row, _G.data() + row, stride, i_begin,
+              i_end, _row_params);
+}
+
+void Fields::rs_row(int j, int i_begin, int i_end, double inv_dx, double inv_dy, double inv_dt) {
+    for (int i = i_begin; i < i_end; ++i) {
+        _RS(i, j) = ((_F(i, j) - _F(i - 1, j)) * inv_dx + (_G(i, j) - _G(i, j - 1)) * inv_dy) * inv_dt;
+    }
+}
+
+void Fields::temperature_kernel_rows(Grid &grid) {
+    const RowKernelParams params = row_kernel_params();
+    const int stride = _T.imax();
+
+    grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        const int row = stride * j;
+        _temperature_row(_T.data() + row, _U.data() + row, _V.data() + row, _T_new.data() + row, stride, i_begin,
+                         i_end, params);
+    });
 }
 
 void Fields::calculate_fluxes(Grid &grid) {
-    int i, j;
+    if (_implicit_diffusion) {
+        // F and G outside of the unknowns are the boundary values of the implicit solve
+        _F = _U;
+        _G = _V;
+    }
+
+    _row_params = row_kernel_params();
+    if (_integrator == time_integrator::EULER) {
+        grid.parallel_for_each_fluid_span(
+            [&](int j, int i_begin, int i_end) { (this->*_flux_kernel)(j, i_begin, i_end); });
+    } else {
+        grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+            (this->*_flux_kernel)(j, i_begin, i_end);
+            integrate_fluxes(j, i_begin, i_end);
+        });
+    }
+
+    calculate_boundary_fluxes();
+
+    if (_implicit_diffusion) {
+        _F_explicit = _F;
+        _G_explicit = _G;
+    }
+}
 
-    if (_energy_eq == "off") {
-        for (const auto &currentCell : grid.fluid_cells()) {
-            i = currentCell->i();
-            j = currentCell->j();
+void Fields::set_time_integrator(time_integrator integrator) {
+    _integrator = integrator;
+    const int imax = _U.imax();
+    const int jmax = _U.jmax();
+    switch (integrator) {
+    case time_integrator::AB2:
+        _F_rate = Matrix<double>(imax, jmax, 0.0);
+        _G_rate = Matrix<double>(imax, jmax, 0.0);
+        _T_rate = Matrix<double>(imax, jmax, 0.0);
+        // stable up to -1 on the real axis instead of -2, and only just on the imaginary axis
+        _diffusive_dt_scale = 0.5;
+        _convective_dt_scale = 0.5;
+        break;
+    case time_integrator::SSP_RK3:
+        _U_start = Matrix<double>(imax, jmax, 0.0);
+        _V_start = Matrix<double>(imax, jmax, 0.0);
+        _T_start = Matrix<double>(imax, jmax, 0.0);
+        // stable up to -2.51 on the real axis; a convex combination of Euler steps, so
+        // the upwind convection is stable at the Euler CFL number
+        _diffusive_dt_scale = 1.25;
+        _convective_dt_scale = 1.0;
+        break;
+    default:
+        _diffusive_dt_scale = 1.0;
+        _convective_dt_scale = 1.0;
+        break;
+    }
+}
+
+void Fields::begin_stage(int stage) {
+    switch (_integrator) {
+    case time_integrator::AB2:
+        // Adams-Bashforth 2 for variable timesteps
+        _rate_weight = _rate_dt > 0.0 ? 0.5 * _dt / _rate_dt : 0.0;
+        _rate_dt = _dt;
+        break;
+    case time_integrator::SSP_RK3: {
+        static const double weights[3] = {1.0, 0.25, 2.0 / 3.0};
+        _stage_weight = weights[stage];
+        if (stage == 0) {
+            _U_start = _U;
+            _V_start = _V;
+            _T_start = _T;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void Fields::integrate_fluxes(int j, int i_begin, int i_end) {
+    if (_integrator == time_integrator::AB2) {
+        const double inv_dt = 1.0 / _dt;
+        const double current = 1.0 + _rate_weight;
+        for (int i = i_begin; i < i_end; ++i) {
+            const double f_rate = (_F(i, j) - _U(i, j)) * inv_dt;
+            const double g_rate = (_G(i, j) - _V(i, j)) * inv_dt;
+            _F(i, j) = _U(i, j) + _dt * (current * f_rate - _rate_weight * _F_rate(i, j));
+            _G(i, j) = _V(i, j) + _dt * (current * g_rate - _rate_weight * _G_rate(i, j));
+            _F_rate(i, j) = f_rate;
+            _G_rate(i, j) = g_rate;
+        }
+    } else if (_stage_weight != 1.0) {
+        const double start = 1.0 - _stage_weight;
+        for (int i = i_begin; i < i_end; ++i) {
+            _F(i, j) = start * _U_start(i, j) + _stage_weight * _F(i, j);
+            _G(i, j) = start * _V_start(i, j) + _stage_weight * _G(i, j);
+        }
+    }
+}
 
-            if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-                _F(i, j) = _U(i, j) + _dt * (_nu * (Discretization::laplacian(_U, i, j)) -
-                                             Discretization::convection_u(_U, _V, i, j) + _gx);
-                _G(i, j) = _V(i, j) + _dt * (_nu * (Discretization::laplacian(_V, i, j)) -
-                                             Discretization::convection_v(_U, _V, i, j) + _gy);
+void Fields::integrate_temperatures(Grid &grid) {
+    if (_integrator == time_integrator::AB2) {
+        const double inv_dt = 1.0 / _dt;
+        const double current = 1.0 + _rate_weight;
+        grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+            for (int i = i_begin; i < i_end; ++i) {
+                const double t_rate = (_T_new(i, j) - _T(i, j)) * inv_dt;
+                _T(i, j) = _T(i, j) + _dt * (current * t_rate - _rate_weight * _T_rate(i, j));
+                _T_rate(i, j) = t_rate;
             }
+        });
+        return;
+    }
+    const double start = 1.0 - _stage_weight;
+    grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        for (int i = i_begin; i < i_end; ++i) {
+            _T(i, j) = start * _T_start(i, j) + _stage_weight * _T_new(i, j);
+        }
+    });
+}
+
+void Fields::set_energy_subcycling(bool subcycling) {
+    _energy_subcycling = subcycling && _energy_on;
+    if (_energy_subcycling) {
+        _U_step = Matrix<double>(_U.imax(), _U.jmax(), 0.0);
+        _V_step = Matrix<double>(_V.imax(), _V.jmax(), 0.0);
+        _U_substep = Matrix<double>(_U.imax(), _U.jmax(), 0.0);
+        _V_substep = Matrix<double>(_V.imax(), _V.jmax(), 0.0);
+    }
+}
+
+void Fields::store_step_velocities() {
+    _U_step = _U;
+    _V_step = _V;
+}
+
+void Fields::calculate_temperature_substep(Grid &grid, int substep, int substeps) {
+    const double step_dt = _dt;
+    const double weight = static_cast<double>(substep) / substeps;
+    const int row = _U.imax();
+    double *u = _U_substep.data();
+    double *v = _V_substep.data();
+    const double *u_old = _U_step.data();
+    const double *v_old = _V_step.data();
+    const double *u_new = _U.data();
+    const double *v_new = _V.data();
+    // the ghost velocities on the boundary faces are interpolated as well, so whole rows are one task each
+    Threading::for_each_task(_U.jmax(), [&](int j) {
+        for (int k = j * row; k < (j + 1) * row; ++k) {
+            u[k] = (1.0 - weight) * u_old[k] + weight * u_new[k];
+            v[k] = (1.0 - weight) * v_old[k] + weight * v_new[k];
         }
-    } else if (_energy_eq == "on") {
-        for (const auto &currentCell : grid.fluid_cells()) {
-            i = currentCell->i();
-            j = currentCell->j();
-
-            if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-                _F(i, j) = _U(i, j) + _dt * (_nu * (Discretization::laplacian(_U, i, j)) -
-                                             Discretization::convection_u(_U, _V, i, j));
-                _F(i, j) -= 0.5 * _dt * _beta * (_T(i, j) + _T(i + 1, j)) * _gx;
-                _G(i, j) = _V(i, j) + _dt * (_nu * (Discretization::laplacian(_V, i, j)) -
-                                             Discretization::convection_v(_U, _V, i, j));
-                _G(i, j) -= 0.5 * _dt * _beta * (_T(i, j) + _T(i, j + 1)) * _gy;
+    });
+
+    // the temperature kernels read _U, _V and _dt
+    std::swap(_U, _U_substep);
+    std::swap(_V, _V_substep);
+    _dt = step_dt / substeps;
+    calculate_temperatures(grid);
+    _dt = step_dt;
+    std::swap(_U, _U_substep);
+    std::swap(_V, _V_substep);
+}
+
+void Fields::set_implicit_diffusion(Grid &grid, bool implicit) {
+    _implicit_diffusion = implicit;
+    _explicit_nu = implicit ? 0.0 : _nu;
+    _explicit_alpha = implicit ? 0.0 : _alpha;
+    if (!implicit) {
+        return;
+    }
+
+    const int stride = _U.imax();
+    _diffusion_faces.assign(_U.size(), 0);
+    grid.for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        for (int i = i_begin; i < i_end; ++i) {
+            unsigned char faces = 0;
+            if (grid.is_fluid(i + 1, j)) {
+                faces |= 1;
+            }
+            if (grid.is_fluid(i, j + 1)) {
+                faces |= 2;
             }
+            _diffusion_faces[stride * j + i] = faces;
+        }
+    });
+}
+
+void Fields::redistribute(Grid &grid, const Domain &from) {
+    // the matrices of options that are off stay empty on all processes alike
+    std::vector<Matrix<double> *> matrices;
+    for (auto *matrix : {&_U, &_V, &_P, &_F, &_G, &_RS, &_T, &_T_new, &_F_explicit, &_G_explicit, &_U_old, &_V_old,
+                         &_P_old, &_T_old, &_U_start, &_V_start, &_T_start, &_F_rate, &_G_rate, &_T_rate, &_U_step,
+                         &_V_step, &_U_substep, &_V_substep}) {
+        if (matrix->size() > 0) {
+            matrices.push_back(matrix);
         }
-    } else {
-        std::cout << "Something went wrong with energy equation on and off\nPlease check\n";
-        Communication::abort();
     }
+    Communication::migrate(matrices, from, grid.domain());
+
+    compile_boundary_fluxes(grid);
+    set_implicit_diffusion(grid, _implicit_diffusion);
+    // the velocity maxima still belong to the previous subdomain, but only their maximum over all processes matters
+}
 
-    for (const auto &boundary :
-         {grid.fixed_wall_cells(), grid.hot_fixed_wall_cells(), grid.cold_fixed_wall_cells(),
-          grid.adiabatic_fixed_wall_cells(), grid.inflow_cells(), grid.outflow_cells(), grid.moving_wall_cells()}) {
-        for (const auto &currentCell : boundary) {
-            i = currentCell->i();
-            j = currentCell->j();
-            if (currentCell->is_border(border_position::TOP)) {
-                if (currentCell->is_border(border_position::RIGHT)) {
-                    _F(i, j) = 0.0;
-                    _G(i, j) = 0.0;
-                } else if (currentCell->is_border(border_position::LEFT)) {
-                    _F(i - 1, j) = 0.0;
-                    _G(i, j) = 0.0;
-                } else if (currentCell->is_border(border_position::BOTTOM)) {
-                    _G(i, j) = 0.0;
-                    _G(i, j - 1) = 0.0;
+double Fields::diffuse_velocities(Grid &grid) {
+    const Stencil s = Discretization::stencil();
+    const double r_x = _dt * _nu * s.inv_dx2;
+    const double r_y = _dt * _nu * s.inv_dy2;
+    const double diagonal = 1.0 + 2.0 * (r_x + r_y);
+    const int stride = _F.imax();
+
+    // only one thread at a time works on a row, see Grid::ordered_for_each_fluid_cell()
+    std::vector<double> rows(grid.domain().size_y + 2, 0.0);
+    grid.ordered_for_each_fluid_cell([&](int i, int j) {
+        const unsigned char faces = _diffusion_faces[stride * j + i];
+        if (faces & 1) {
+            double sum = _F_explicit(i, j) + r_x * (_F(i + 1, j) + _F(i - 1, j)) + r_y * (_F(i, j + 1) + _F(i, j - 1));
+            double res = sum - diagonal * _F(i, j);
+            rows[j] += res * res;
+            _F(i, j) = sum / diagonal;
+        }
+        if (faces & 2) {
+            double sum = _G_explicit(i, j) + r_x * (_G(i + 1, j) + _G(i - 1, j)) + r_y * (_G(i, j + 1) + _G(i, j - 1));
+            double res = sum - diagonal * _G(i, j);
+            rows[j] += res * res;
+            _G(i, j) = sum / diagonal;
+        }
+    });
+
+    double rloc = 0.0;
+    for (double row : rows) {
+        rloc += row;
+    }
+    return rloc;
+}
+
+double Fields::diffuse_temperature(Grid &grid) {
+    const Stencil s = Discretization::stencil();
+    const double r_x = _dt * _alpha * s.inv_dx2;
+    const double r_y = _dt * _alpha * s.inv_dy2;
+    const double diagonal = 1.0 + 2.0 * (r_x + r_y);
+
+    std::vector<double> rows(grid.domain().size_y + 2, 0.0);
+    grid.ordered_for_each_fluid_cell([&](int i, int j) {
+        double sum = _T_new(i, j) + r_x * (_T(i + 1, j) + _T(i - 1, j)) + r_y * (_T(i, j + 1) + _T(i, j - 1));
+        double res = sum - diagonal * _T(i, j);
+        rows[j] += res * res;
+        _T(i, j) = sum / diagonal;
+    });
+
+    double rloc = 0.0;
+    for (double row : rows) {
+        rloc += row;
+    }
+    return rloc;
+}
+
+void Fields::calculate_fluxes_rs(Grid &grid) {
+    const double inv_dx = 1.0 / grid.dx();
+    const double inv_dy = 1.0 / grid.dy();
+    const double inv_dt = 1.0 / projection_dt();
+
+    // Rows are visited bottom-up, so F(i - 1, j) and G(i, j - 1) of cells away from
+    // the rim are already final when RS(i, j) is formed right after the fluxes.
+    // The first row of every tile needs G of a row of another tile, which may be
+    // written meanwhile, so it is only formed once all tiles are through.
+    _row_params = row_kernel_params();
+    const bool integrate = _integrator != time_integrator::EULER;
+    grid.parallel_for_each_fluid_tile([&](int j_begin, int j_end) {
+        grid.for_each_fluid_span_in_rows(j_begin, j_end, [&](int j, int i_begin, int i_end) {
+            (this->*_flux_kernel)(j, i_begin, i_end);
+            if (integrate) {
+                integrate_fluxes(j, i_begin, i_end);
+            }
+            if (j != j_begin) {
+                rs_row(j, i_begin, i_end, inv_dx, inv_dy, inv_dt);
+            }
+        });
+    });
+    grid.parallel_for_each_fluid_tile([&](int j_begin, int) {
+        grid.for_each_fluid_span_in_rows(j_begin, j_begin + 1, [&](int j, int i_begin, int i_end) {
+            rs_row(j, i_begin, i_end, inv_dx, inv_dy, inv_dt);
+        });
+    });
+
+    calculate_boundary_fluxes();
+}
+
+void Fields::calculate_rs_rim(Grid &grid) {
+    const double inv_dx = 1.0 / grid.dx();
+    const double inv_dy = 1.0 / grid.dy();
+    const double inv_dt = 1.0 / projection_dt();
+
+    const auto &rim = grid.fluid_rim_cells();
+    Threading::for_each_task(static_cast<int>(rim.size()), [&](int k) {
+        rs_row(rim[k]->j(), rim[k]->i(), rim[k]->i() + 1, inv_dx, inv_dy, inv_dt);
+    });
+}
+
+void Fields::calculate_boundary_fluxes() {
+    // every boundary cell only writes the fluxes on its own faces towards the fluid
+    _boundary_f.apply_parallel(_U.data(), _F.data());
+    _boundary_g.apply_parallel(_V.data(), _G.data());
+}
+
+void Fields::compile_boundary_fluxes(Grid &grid) {
+    _boundary_f = BoundaryTable(_U.imax());
+    _boundary_g = BoundaryTable(_V.imax());
+    for (const auto *boundary :
+         {&grid.fixed_wall_cells(), &grid.hot_fixed_wall_cells(), &grid.cold_fixed_wall_cells(),
+          &grid.adiabatic_fixed_wall_cells(), &grid.inflow_cells(), &grid.outflow_cells(),
+          &grid.convective_outflow_cells(), &grid.moving_wall_cells()}) {
+        for (const Cell *currentCell : *boundary) {
+            const int i = currentCell->i();
+            const int j = currentCell->j();
+            if (grid.is_border(i, j, border_position::TOP)) {
+                if (grid.is_border(i, j, border_position::RIGHT)) {
+                    _boundary_f.set(i, j, 0.0);
+                    _boundary_g.set(i, j, 0.0);
+                } else if (grid.is_border(i, j, border_position::LEFT)) {
+                    _boundary_f.set(i - 1, j, 0.0);
+                    _boundary_g.set(i, j, 0.0);
+                } else if (grid.is_border(i, j, border_position::BOTTOM)) {
+                    _boundary_g.set(i, j, 0.0);
+                    _boundary_g.set(i, j - 1, 0.0);
                 } else {
-                    _G(i, j) = _V(i, j);
+                    _boundary_g.set(i, j, 1.0, i, j);
                 }
-            } else if (currentCell->is_border(border_position::BOTTOM)) {
-                if (currentCell->is_border(border_position::RIGHT)) {
-                    _F(i, j) = 0.0;
-                    _G(i, j - 1) = 0.0;
-                } else if (currentCell->is_border(border_position::LEFT)) {
-                    _F(i - 1, j) = 0.0;
-                    _G(i, j - 1) = 0.0;
+            } else if (grid.is_border(i, j, border_position::BOTTOM)) {
+                if (grid.is_border(i, j, border_position::RIGHT)) {
+                    _boundary_f.set(i, j, 0.0);
+                    _boundary_g.set(i, j - 1, 0.0);
+                } else if (grid.is_border(i, j, border_position::LEFT)) {
+                    _boundary_f.set(i - 1, j, 0.0);
+                    _boundary_g.set(i, j - 1, 0.0);
                 } else {
-                    _G(i, j - 1) = _V(i, j - 1);
+                    _boundary_g.set(i, j - 1, 1.0, i, j - 1);
                 }
-            } else if (currentCell->is_border(border_position::RIGHT)) {
-                if (currentCell->is_border(border_position::LEFT)) {
-                    _F(i, j) = 0.0;
-                    _F(i - 1, j) = 0.0;
+            } else if (grid.is_border(i, j, border_position::RIGHT)) {
+                if (grid.is_border(i, j, border_position::LEFT)) {
+                    _boundary_f.set(i, j, 0.0);
+                    _boundary_f.set(i - 1, j, 0.0);
                 } else {
-                    _F(i, j) = _U(i, j);
+                    _boundary_f.set(i, j, 1.0, i, j);
                 }
-            } else if (currentCell->is_border(border_position::LEFT)) {
-                _F(i - 1, j) = _U(i - 1, j);
+            } else if (grid.is_border(i, j, border_position::LEFT)) {
+                _boundary_f.set(i - 1, j, 1.0, i - 1, j);
             }
         }
     }
 }
 
 void Fields::calculate_rs(Grid &grid) {
-    double dx = grid.dx();
-    double dy = grid.dy();
-    int i, j;
-    for (const auto &currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            _RS(i, j) = (((_F(i, j) - _F(i - 1, j)) / dx) + ((_G(i, j) - _G(i, j - 1)) / dy)) / _dt;
-        }
-    }
+    const double inv_dx = 1.0 / grid.dx();
+    const double inv_dy = 1.0 / grid.dy();
+    const double inv_dt = 1.0 / projection_dt();
+
+    grid.parallel_for_each_fluid_span(
+        [&](int j, int i_begin, int i_end) { rs_row(j, i_begin, i_end, inv_dx, inv_dy, inv_dt); });
 }
 
-void Fields::calculate_velocities(Grid &grid) {
-    double dx = grid.dx();
-    double dy = grid.dy();
-    int i, j;
-    for (const auto &currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            _U(i, j) = _F(i, j) - (_dt / dx) * (_P(i + 1, j) - _P(i, j));
-            _V(i, j) = _G(i, j) - (_dt / dy) * (_P(i, j + 1) - _P(i, j));
+void Fields::calculate_velocities(Grid &grid, subdomain_part part) {
+    const double dt_dx = projection_dt() / grid.dx();
+    const double dt_dy = projection_dt() / grid.dy();
+
+    grid.parallel_for_each_fluid_span(part, [&](int j, int i_begin, int i_end) {
+        for (int i = i_begin; i < i_end; ++i) {
+            _U(i, j) = _F(i, j) - dt_dx * (_P(i + 1, j) - _P(i, j));
+            _V(i, j) = _G(i, j) - dt_dy * (_P(i, j + 1) - _P(i, j));
         }
+    });
+}
+
+void Fields::calculate_velocities_max(Grid &grid, subdomain_part part) {
+    const double dt_dx = projection_dt() / grid.dx();
+    const double dt_dy = projection_dt() / grid.dy();
+
+    const auto max = grid.reduce_fluid_spans<2>(
+        [&](int j, int i_begin, int i_end) {
+            std::array<double, 2> row_max{};
+            for (int i = i_begin; i < i_end; ++i) {
+                _U(i, j) = _F(i, j) - dt_dx * (_P(i + 1, j) - _P(i, j));
+                _V(i, j) = _G(i, j) - dt_dy * (_P(i, j + 1) - _P(i, j));
+                row_max[0] = std::max(row_max[0], std::abs(_U(i, j)));
+                row_max[1] = std::max(row_max[1], std::abs(_V(i, j)));
+            }
+            return row_max;
+        },
+        max_of, part);
+
+    if (part == subdomain_part::FRAME) {
+        _umax = std::max(_umax, max[0]);
+        _vmax = std::max(_vmax, max[1]);
+    } else {
+        _umax = std::max(0.001, max[0]);
+        _vmax = std::max(0.001, max[1]);
     }
+    _velocity_max_valid = part != subdomain_part::INNER;
 }
 
 double Fields::calculate_dt(Grid &grid) {
     double dt1, dt2, dt3, dt4;
     double dx = grid.dx();
     double dy = grid.dy();
-    double umax = 0.001;
-    double vmax = 0.001;
-    int i, j;
+    double umax = _umax;
+    double vmax = _vmax;
 
-    for (const auto &currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (umax < std::abs(_U(i, j))) {
-            umax = std::abs(_U(i, j));
-        }
-        if (vmax < std::abs(_V(i, j))) {
-            vmax = std::abs(_V(i, j));
-        }
+    // the maxima are only reused once, right after calculate_velocities_max()
+    if (!_velocity_max_valid) {
+        const auto max = grid.reduce_fluid_spans<2>(
+            [&](int j, int i_begin, int i_end) {
+                std::array<double, 2> row_max{};
+                for (int i = i_begin; i < i_end; ++i) {
+                    row_max[0] = std::max(row_max[0], std::abs(_U(i, j)));
+                    row_max[1] = std::max(row_max[1], std::abs(_V(i, j)));
+                }
+                return row_max;
+            },
+            max_of);
+        umax = std::max(0.001, max[0]);
+        vmax = std::max(0.001, max[1]);
+    }
+    _velocity_max_valid = false;
+
+    if (_implicit_diffusion) {
+        // Without the diffusive limits a flow starting from rest would only see the
+        // 0.001 floor, so the velocity driving it is taken into account as well
+        umax = std::max(umax, _driving_velocity);
     }
 
     dt1 = 0.5 * (dx * dx * dy * dy) / ((dx * dx + dy * dy) * _nu);
     dt2 = dx / umax;
     dt3 = dy / vmax;
-    if (_energy_eq == "on") {
+    if (_implicit_diffusion) {
+        // implicit diffusion is stable for any timestep, only the convective limits apply;
+        // the timestep may at most double per step, so that the explicit forces and
+        // the velocities can catch up with it
+        _dt = std::min(_tau * std::min(dt2, dt3), 2.0 * _dt);
+    } else if (_energy_subcycling) {
+        // the thermal diffusion limit only applies to the temperature substeps
         dt4 = 0.5 * (dx * dx * dy * dy) / ((dx * dx + dy * dy) * _alpha);
-        _dt = _tau * std::min({dt1, dt2, dt3, dt4});
-    } else {
+        _temperature_dt = _tau * std::min({dt2, dt3, dt4});
         _dt = _tau * std::min({dt1, dt2, dt3});
+    } else if (_energy_on) {
+        dt4 = 0.5 * (dx * dx * dy * dy) / ((dx * dx + dy * dy) * _alpha);
+        _dt = _tau * std::min({_diffusive_dt_scale * dt1, _convective_dt_scale * dt2, _convective_dt_scale * dt3,
+                               _diffusive_dt_scale * dt4});
+    } else {
+        _dt = _tau * std::min({_diffusive_dt_scale * dt1, _convective_dt_scale * dt2, _convective_dt_scale * dt3});
     }
     return _dt;
 }
 
-void Fields::calculate_temperatures(Grid &grid) {
-    int i, j;
-    for (const auto &currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            _T_new(i, j) = _T(i, j) + _dt * (_alpha * Discretization::laplacian(_T, i, j) -
-                                             Discretization::convection_t(_T, _U, _V, i, j));
+std::array<double, 8> Fields::state_change(Grid &grid) {
+    if (_U_old.size() != _U.size()) {
+        _U_old = _U;
+        _V_old = _V;
+        _P_old = _P;
+        _T_old = _T;
+        // an infinite change of finite fields, so that the first sample never counts as steady
+        std::array<double, 8> change{};
+        for (int k = 0; k < 8; k += 2) {
+            change[k] = std::numeric_limits<double>::infinity();
+            change[k + 1] = 1.0;
+        }
+        return change;
+    }
+
+    const bool energy = _energy_on;
+    return grid.reduce_fluid_spans<8>(
+        [&](int j, int i_begin, int i_end) {
+            std::array<double, 8> row{};
+            for (int i = i_begin; i < i_end; ++i) {
+                raise_max(row[0], std::abs(_U(i, j) - _U_old(i, j)));
+                raise_max(row[1], std::abs(_U(i, j)));
+                raise_max(row[2], std::abs(_V(i, j) - _V_old(i, j)));
+                raise_max(row[3], std::abs(_V(i, j)));
+                raise_max(row[4], std::abs(_P(i, j) - _P_old(i, j)));
+                raise_max(row[5], std::abs(_P(i, j)));
+                _U_old(i, j) = _U(i, j);
+                _V_old(i, j) = _V(i, j);
+                _P_old(i, j) = _P(i, j);
+                if (energy) {
+                    raise_max(row[6], std::abs(_T(i, j) - _T_old(i, j)));
+                    raise_max(row[7], std::abs(_T(i, j)));
+                    _T_old(i, j) = _T(i, j);
+                }
+            }
+            return row;
+        },
+        max_of);
+}
+
+double Fields::state_change_rate(const std::array<double, 8> &change, double dt) {
+    double rate = 0.0;
+    for (int k = 0; k < 8; k += 2) {
+        const double difference = change[k];
+        const double magnitude = change[k + 1];
+        if (std::isinf(magnitude)) {
+            // the field is no longer finite, see state_change()
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        if (magnitude > 0.0) {
+            rate = std::max(rate, difference / magnitude);
+        } else if (difference > 0.0) {
+            // a field that just dropped to zero everywhere
+            rate = std::numeric_limits<double>::infinity();
         }
     }
-    _T = _T_new;
+    return rate / dt;
+}
+
+void Fields::calculate_temperatures(Grid &grid) {
+    (this->*_temperature_kernel)(grid);
+    // with implicit diffusion _T_new only holds the explicit part, see diffuse_temperature()
+    if (_implicit_diffusion) {
+        return;
+    }
+    if (_integrator == time_integrator::EULER) {
+        _T = _T_new;
+    } else {
+        integrate_temperatures(grid);
+    }
 }
 
 double &Fields::t(int i, int j) { return _T(i, j); }
@@ -200,3 +705,5 @@ Matrix<double> &Fields::g_matrix() { return _G; }
 Matrix<double> &Fields::rs_matrix() { return _RS; }
 
 double Fields::dt() const { return _dt; }
+
+void Fields::set_dt(double dt) { _dt = dt; }
@@ -6,7 +6,6 @@
 #include <fstream>
 #include <iostream>
 #include <mpi.h>
-#include <sstream>
 #include <vector>
 
 Grid::Grid(std::string geom_name, Domain &domain, int process_rank, int size, int iproc, int jproc) {
@@ -29,6 +28,96 @@ Grid::Grid(std::string geom_name, Domain &domain, int process_rank, int size, in
     else {
         build_lid_driven_cavity(geom_name);
     }
+
+    build_cell_flags();
+    build_fluid_spans();
+    build_fluid_tiles();
+}
+
+void Grid::build_cell_flags() {
+    _flags = Matrix<unsigned char>(_domain.size_x + 2, _domain.size_y + 2, 0);
+    for (int j = 0; j < _domain.size_y + 2; ++j) {
+        for (int i = 0; i < _domain.size_x + 2; ++i) {
+            const Cell &cell = _cells(i, j);
+            unsigned char flags = static_cast<unsigned char>(cell.type());
+            for (auto position :
+                 {border_position::TOP, border_position::BOTTOM, border_position::LEFT, border_position::RIGHT}) {
+                if (cell.is_border(position)) {
+                    flags |= cell_flags::border(position);
+                }
+            }
+            _flags(i, j) = flags;
+        }
+    }
+}
+
+void Grid::build_fluid_spans() {
+    _fluid_spans.clear();
+    _row_spans.assign(_domain.size_y + 2, 0);
+    for (int j = 1; j <= _domain.size_y; ++j) {
+        _row_spans[j] = static_cast<int>(_fluid_spans.size());
+        int i = 1;
+        while (i <= _domain.size_x) {
+            if (!is_fluid(i, j)) {
+                ++i;
+                continue;
+            }
+            int i_begin = i;
+            while (i <= _domain.size_x && is_fluid(i, j)) {
+                ++i;
+            }
+            _fluid_spans.push_back(FluidSpan{j, i_begin, i});
+        }
+    }
+    _row_spans[_domain.size_y + 1] = static_cast<int>(_fluid_spans.size());
+
+    _fluid_rim_cells.clear();
+    for (int j = 1; j <= _domain.size_y; ++j) {
+        for (int i = 1; i <= _domain.size_x; ++i) {
+            if (!is_fluid(i, j)) {
+                continue;
+            }
+            bool rim = i == 1 || j == 1 || i == _domain.size_x || j == _domain.size_y;
+            rim = rim || !is_fluid(i - 1, j) || !is_fluid(i + 1, j) || !is_fluid(i, j - 1) || !is_fluid(i, j + 1);
+            if (rim) {
+                _fluid_rim_cells.push_back(&_cells(i, j));
+            }
+        }
+    }
+
+    // dense if every interior row consists of a single full-width span
+    _dense = static_cast<int>(_fluid_spans.size()) == _domain.size_y;
+    for (const auto &span : _fluid_spans) {
+        _dense = _dense && span.i_begin == 1 && span.i_end == _domain.size_x + 1;
+    }
+}
+
+void Grid::build_fluid_tiles() {
+    std::vector<int> row_cells(_domain.size_y + 2, 0);
+    long total = 0;
+    for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        row_cells[j] += i_end - i_begin;
+        total += i_end - i_begin;
+    });
+
+    // a few tiles per thread leave room for stealing, a tile never reaches over a row without fluid
+    const long tiles = 4 * Threading::num_threads();
+    const long target = std::max(1L, (total + tiles - 1) / tiles);
+    _fluid_tiles.clear();
+    int j = 1;
+    while (j <= _domain.size_y) {
+        if (row_cells[j] == 0) {
+            ++j;
+            continue;
+        }
+        const int j_begin = j;
+        long cells = 0;
+        while (j <= _domain.size_y && row_cells[j] > 0 && cells < target) {
+            cells += row_cells[j];
+            ++j;
+        }
+        _fluid_tiles.push_back(FluidTile{j_begin, j});
+    }
 }
 
 void Grid::build_lid_driven_cavity(std::string geom_name) {
@@ -87,6 +176,9 @@ void Grid::assign_cell_types(std::vector<std::vector<int>> &geometry_data, std::
                 } else if (geometry_data.at(i_geom).at(j_geom) == outflow_wall_id) {
                     _cells(i, j) = Cell(i, j, cell_type::OUTFLOW, geometry_data.at(i_geom).at(j_geom));
                     _outflow_cells.push_back(&_cells(i, j));
+                } else if (geometry_data.at(i_geom).at(j_geom) == convective_outflow_wall_id) {
+                    _cells(i, j) = Cell(i, j, cell_type::OUTFLOW, geometry_data.at(i_geom).at(j_geom));
+                    _convective_outflow_cells.push_back(&_cells(i, j));
                 } else if (geometry_data.at(i_geom).at(j_geom) == fixed_wall_id) {
                     _cells(i, j) = Cell(i, j, cell_type::FIXED_WALL, geometry_data.at(i_geom).at(j_geom));
                     _fixed_wall_cells.push_back(&_cells(i, j));
@@ -266,51 +358,133 @@ void Grid::assign_cell_types(std::vector<std::vector<int>> &geometry_data, std::
     }
 }
 
-void Grid::parse_geometry_file(std::string filedoc, std::vector<std::vector<int>> &geometry_data) {
+namespace {
+/// Format, size and start of the cell ids of a pgm file
+struct PgmHeader {
+    /// "P5" stores the ids as raw bytes, "P2" as text
+    bool binary{false};
+    int numrows{0};
+    int numcols{0};
+    int depth{0};
+    /// offset of the first cell id
+    std::streamoff data{0};
+    /// comment lines of the header
+    std::vector<std::string> comments;
+};
+
+/// next integer of the header, collecting the comment lines in between
+int header_value(std::ifstream &infile, std::vector<std::string> &comments) {
+    infile >> std::ws;
+    while (infile.peek() == '#') {
+        std::string comment;
+        getline(infile, comment);
+        comments.push_back(comment);
+        infile >> std::ws;
+    }
+    int value = 0;
+    infile >> value;
+    return value;
+}
 
-    if (_process_rank == 0) {
-        int numcols, numrows, depth;
-        std::vector<std::vector<int>> full_domain(_domain.domain_size_x + 2,
-                                                  std::vector<int>(_domain.domain_size_y + 2, 0));
-
-        std::ifstream infile(filedoc);
-        std::ifstream legend_lines(filedoc);
-        std::stringstream ss;
-        std::string inputLine = "";
-
-        // First line : version
-        getline(infile, inputLine);
-        if (inputLine.compare("P2") != 0) {
-            std::cerr << "First line of the PGM file should be P2" << std::endl;
+PgmHeader read_header(std::ifstream &infile) {
+    PgmHeader header;
+    std::string version;
+    // First line : version
+    infile >> version;
+    header.binary = (version.compare("P5") == 0);
+    if (version.compare("P2") != 0 && !header.binary) {
+        std::cerr << "First line of the PGM file should be P2 or P5" << std::endl;
+    }
+    // Then size and depth, possibly with comments in between
+    header.numrows = header_value(infile, header.comments);
+    header.numcols = header_value(infile, header.comments);
+    header.depth = header_value(infile, header.comments);
+    // A single whitespace separates the depth from the binary data
+    infile.get();
+    header.data = infile.tellg();
+    return header;
+}
+} // namespace
+
+std::vector<std::vector<int>> Grid::read_geometry(const std::string &filedoc, const Domain &domain, int imin, int imax,
+                                                  int jmin, int jmax) {
+    std::vector<std::vector<int>> geometry(imax - imin, std::vector<int>(jmax - jmin, 0));
+
+    std::ifstream infile(filedoc, std::ios::binary);
+    const PgmHeader header = read_header(infile);
+    if (header.numrows != domain.domain_size_x + 2 || header.numcols != domain.domain_size_y + 2) {
+        std::cerr << "Error: Size of the PGM file does not match imax + 2 and jmax + 2\nPlease check the file\n";
+        Communication::abort();
+        exit(0);
+    }
+
+    if (header.binary) {
+        // Seek to the part of every line of cells in the slab, the lines run from top to bottom
+        const int bytes = (header.depth < 256) ? 1 : 2;
+        std::vector<unsigned char> line((imax - imin) * bytes);
+        for (int col = jmin; col < jmax; ++col) {
+            const std::streamoff offset =
+                (static_cast<std::streamoff>(header.numcols - 1 - col) * header.numrows + imin) * bytes;
+            infile.seekg(header.data + offset);
+            infile.read(reinterpret_cast<char *>(line.data()), line.size());
+            for (int row = imin; row < imax; ++row) {
+                const int k = (row - imin) * bytes;
+                // two byte ids are stored most significant byte first
+                geometry[row - imin][col - jmin] = (bytes == 1) ? line[k] : (line[k] << 8) | line[k + 1];
+            }
+        }
+    } else {
+        // Text has no offsets, so all lines above the slab are skipped value by value
+        int id;
+        for (int col = header.numcols - 1; col >= jmin; --col) {
+            for (int row = 0; row < header.numrows; ++row) {
+                infile >> id;
+                if (col < jmax && row >= imin && row < imax) {
+                    geometry[row - imin][col - jmin] = id;
+                }
+            }
         }
+    }
 
-        // Second line : comment
-        getline(infile, inputLine);
+    infile.close();
+    return geometry;
+}
 
-        // Continue with a stringstream
-        ss << infile.rdbuf();
-        // Third line : size
-        ss >> numrows >> numcols;
-        // Fourth line : depth
-        ss >> depth;
+void Grid::parse_geometry_file(std::string filedoc, std::vector<std::vector<int>> &geometry_data) {
 
-        // Following lines : data
-        for (int col = numcols - 1; col > -1; --col) {
-            for (int row = 0; row < numrows; ++row) {
-                ss >> full_domain[row][col];
+    // MPI: Every process reads only its own part of the geometry, including the ghost layer
+    geometry_data = read_geometry(filedoc, _domain, _domain.imin, _domain.imax, _domain.jmin, _domain.jmax);
+
+    if (_process_rank == 0) {
+        std::ifstream legend_file(filedoc, std::ios::binary);
+        const PgmHeader header = read_header(legend_file);
+        // The legend of a binary file is in its header, the one of a text file follows the cell ids
+        std::vector<std::string> legend_lines = header.comments;
+        std::string line = "";
+        if (!header.binary) {
+            while (getline(legend_file, line)) {
+                legend_lines.push_back(line);
             }
         }
+        legend_file.close();
 
         // To read the last few lines to get the id for the wall which are defined in the pgm file
         size_t found;
-        while (getline(legend_lines, inputLine)) {
+        for (const std::string &inputLine : legend_lines) {
+            if (inputLine.size() < 3) {
+                continue;
+            }
             found = inputLine.find("Inflow");
             if (found != std::string::npos) {
                 inflow_wall_id = inputLine[2] - '0';
             }
             found = inputLine.find("Outflow");
             if (found != std::string::npos) {
-                outflow_wall_id = inputLine[2] - '0';
+                if (inputLine.find("Outflow (convective)") != std::string::npos) {
+                    convective_outflow_wall_id = inputLine[2] - '0';
+                } else {
+                    outflow_wall_id = inputLine[2] - '0';
+                }
             }
             found = inputLine.find("Wall/Obstacle") && !inputLine.find("Wall/Obstacle (hot)") &&
                     !inputLine.find("Wall/Obstacle (cold)") && !inputLine.find("Wall/Obstacle (adiabatic)");
@@ -338,119 +512,65 @@ void Grid::parse_geometry_file(std::string filedoc, std::vector<std::vector<int>
                 moving_wall_id = inputLine[2] - '0';
             }
         }
+    }
 
-        infile.close();
-
-        // Checking for boundary cells if they have more fluid cells and throw error to the user
-        int count;
-        for (int col = 1; col < numcols - 1; ++col) {
-            for (int row = 1; row < numrows - 1; ++row) {
-                if (full_domain[row][col] != 0) {
-                    count = 0;
-                    if (full_domain[row - 1][col] == 0) {
-                        count++;
-                    }
-                    if (full_domain[row][col - 1] == 0) {
-                        count++;
-                    }
-                    if (full_domain[row + 1][col] == 0) {
-                        count++;
-                    }
-                    if (full_domain[row][col + 1] == 0) {
-                        count++;
-                    }
-                    if (count > 2) {
-                        std::cerr << "Error: Given PGM file has a boundary with more fluid neighbors\nPlease check the "
-                                     "file\n";
-                        Communication::abort();
-                        exit(0);
-                    }
+    // Checking for boundary cells if they have more fluid cells and throw error to the user
+    int count;
+    for (int col = 1; col <= _domain.size_y; ++col) {
+        for (int row = 1; row <= _domain.size_x; ++row) {
+            if (geometry_data[row][col] != 0) {
+                count = 0;
+                if (geometry_data[row - 1][col] == 0) {
+                    count++;
                 }
-            }
-        }
-
-        // Checking for outer boundary cells if they have fluid cells and throw error to the use
-        for (int col = 1; col < numcols - 1; ++col) {
-            if (full_domain[0][col] == 0 or full_domain[numrows - 1][col] == 0) {
-                std::cerr
-                    << "Error: Given PGM file has a outer boundary cell with fluid wall id\nPlease check the file\n";
-                Communication::abort();
-
-                exit(0);
-            }
-        }
-        for (int row = 1; row < numrows - 1; ++row) {
-            if (full_domain[row][0] == 0 or full_domain[row][numcols - 1] == 0) {
-                std::cerr
-                    << "Error: Given PGM file has a outer boundary cell with fluid wall id\nPlease check the file\n";
-                Communication::abort();
-                exit(0);
-            }
-        }
-
-        // MPI: Geometry data assigning and sending
-        // Assigning Geometry data for 0 (Main) Processor
-        for (int col = 0; col < _domain.jmax - _domain.jmin; ++col) {
-            for (int row = 0; row < _domain.imax - _domain.imin; ++row) {
-                geometry_data[row][col] = full_domain[row][col];
-            }
-        }
-
-        int I, J;
-        int imin, jmin, imax, jmax;
-
-        // Sending Data to other processors
-        for (int i = 1; i < _size; ++i) {
-            I = i % _iproc + 1;
-            J = i / _iproc + 1;
-            imin = (I - 1) * ((numrows - 2) / _iproc);
-            imax = I * ((numrows - 2) / _iproc) + 2;
-            jmin = (J - 1) * ((numcols - 2) / _jproc);
-            jmax = J * ((numcols - 2) / _jproc) + 2;
-
-            // Dumping extra cells in the last processor
-            if (I == _iproc) {
-                if ((numrows - 2) % _iproc != 0) {
-                    imax = imax + ((numrows - 2) % _iproc);
+                if (geometry_data[row][col - 1] == 0) {
+                    count++;
                 }
-            }
-
-            if (J == _jproc) {
-                if ((numcols - 2) % _jproc != 0) {
-                    jmax = jmax + ((numcols - 2) % _jproc);
+                if (geometry_data[row + 1][col] == 0) {
+                    count++;
                 }
-            }
-
-            std::vector<int> geometry_vec;
-            for (int row = imin; row < imax; ++row) {
-                for (int col = jmin; col < jmax; ++col) {
-                    geometry_vec.push_back(full_domain[row][col]);
+                if (geometry_data[row][col + 1] == 0) {
+                    count++;
+                }
+                if (count > 2) {
+                    std::cerr << "Error: Given PGM file has a boundary with more fluid neighbors\nPlease check the "
+                                 "file\n";
+                    Communication::abort();
+                    exit(0);
                 }
             }
-            MPI_Send(&geometry_vec[0], geometry_vec.size(), MPI_INT, i, 789, MPI_COMM_WORLD);
         }
-    } else {
-
-        // Receiving data from the 0 (main) processor
-        std::vector<int> geometry_vec((_domain.imax - _domain.imin) * (_domain.jmax - _domain.jmin));
-        MPI_Status status;
-        MPI_Recv(&geometry_vec[0], geometry_vec.size(), MPI_INT, 0, 789, MPI_COMM_WORLD, &status);
+    }
 
-        for (int col = 0; col < _domain.jmax - _domain.jmin; ++col) {
-            for (int row = 0; row < _domain.imax - _domain.imin; ++row) {
-                geometry_data.at(row).at(col) = geometry_vec[row * (_domain.jmax - _domain.jmin) + col];
-            }
+    // Checking for outer boundary cells if they have fluid cells and throw error to the use
+    const bool left = (_domain.imin == 0);
+    const bool right = (_domain.imax == _domain.domain_size_x + 2);
+    const bool bottom = (_domain.jmin == 0);
+    const bool top = (_domain.jmax == _domain.domain_size_y + 2);
+    for (int col = 1; col <= _domain.size_y; ++col) {
+        if ((left and geometry_data[0][col] == 0) or (right and geometry_data[_domain.size_x + 1][col] == 0)) {
+            std::cerr << "Error: Given PGM file has a outer boundary cell with fluid wall id\nPlease check the file\n";
+            Communication::abort();
+            exit(0);
+        }
+    }
+    for (int row = 1; row <= _domain.size_x; ++row) {
+        if ((bottom and geometry_data[row][0] == 0) or (top and geometry_data[row][_domain.size_y + 1] == 0)) {
+            std::cerr << "Error: Given PGM file has a outer boundary cell with fluid wall id\nPlease check the file\n";
+            Communication::abort();
+            exit(0);
         }
     }
 
     // MPI: Broadcasting Wall Id
-    MPI_Bcast(&inflow_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&outflow_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&fixed_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&hot_fixed_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&cold_fixed_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&adiabatic_fixed_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&moving_wall_id, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&inflow_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&outflow_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&convective_outflow_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&fixed_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&hot_fixed_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&cold_fixed_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&adiabatic_fixed_wall_id, 1, MPI_INT, 0, Communication::communicator());
+    MPI_Bcast(&moving_wall_id, 1, MPI_INT, 0, Communication::communicator());
 }
 
 int Grid::imax() const { return _domain.size_x; }
@@ -459,7 +579,7 @@ int Grid::jmax() const { return _domain.size_y; }
 int Grid::imaxb() const { return _domain.size_x + 2; }
 int Grid::jmaxb() const { return _domain.size_y + 2; }
 
-Cell Grid::cell(int i, int j) const { return _cells(i, j); }
+const Cell &Grid::cell(int i, int j) const { return _cells(i, j); }
 
 double Grid::dx() const { return _domain.dx; }
 
@@ -469,6 +589,14 @@ const Domain &Grid::domain() const { return _domain; }
 
 const std::vector<Cell *> &Grid::fluid_cells() const { return _fluid_cells; }
 
+const std::vector<FluidSpan> &Grid::fluid_spans() const { return _fluid_spans; }
+
+const std::vector<FluidTile> &Grid::fluid_tiles() const { return _fluid_tiles; }
+
+bool Grid::dense() const { return _dense; }
+
+const std::vector<Cell *> &Grid::fluid_rim_cells() const { return _fluid_rim_cells; }
+
 const std::vector<Cell *> &Grid::fixed_wall_cells() const { return _fixed_wall_cells; }
 
 const std::vector<Cell *> &Grid::moving_wall_cells() const { return _moving_wall_cells; }
@@ -477,6 +605,8 @@ const std::vector<Cell *> &Grid::inflow_cells() const { return _inflow_cells; }
 
 const std::vector<Cell *> &Grid::outflow_cells() const { return _outflow_cells; }
 
+const std::vector<Cell *> &Grid::convective_outflow_cells() const { return _convective_outflow_cells; }
+
 const std::vector<Cell *> &Grid::hot_fixed_wall_cells() const { return _hot_fixed_wall_cells; }
 
 const std::vector<Cell *> &Grid::cold_fixed_wall_cells() const { return _cold_fixed_wall_cells; }
@@ -1,36 +1,182 @@
 #include "PressureSolver.hpp"
 
+#include <array>
 #include <cmath>
+#include <functional>
 #include <iostream>
 
+namespace {
+/// two bit code of a neighbour of a fluid cell in the folded PPE operator
+unsigned char neighbour_kind(const Grid &grid, int i, int j) {
+    switch (grid.type(i, j)) {
+    case cell_type::FLUID:
+        return 1;
+    case cell_type::OUTFLOW:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/// adds one neighbour with the given code and 1 / h^2 to the stencil, returns its weight
+double fold_neighbour(unsigned char kind, double inv_h2, double outlet_pressure, PressureStencil &stencil) {
+    if (kind == 1) {
+        // fluid: regular coupling
+        stencil.diagonal += inv_h2;
+        return inv_h2;
+    }
+    if (kind == 2) {
+        // fixed pressure on the face: p_ghost = 2 p_out - p
+        stencil.diagonal += 2.0 * inv_h2;
+        stencil.constant += 2.0 * outlet_pressure * inv_h2;
+    }
+    // zero gradient: p_ghost = p cancels with the centre
+    return 0.0;
+}
+} // namespace
+
+PressureOperator::PressureOperator(const Grid &grid, double outlet_pressure) {
+    const Stencil s = Discretization::stencil();
+    for (int k = 0; k < 256; ++k) {
+        PressureStencil &stencil = _stencils[k];
+        stencil.east = fold_neighbour(k & 3, s.inv_dx2, outlet_pressure, stencil);
+        stencil.west = fold_neighbour((k >> 2) & 3, s.inv_dx2, outlet_pressure, stencil);
+        stencil.north = fold_neighbour((k >> 4) & 3, s.inv_dy2, outlet_pressure, stencil);
+        stencil.south = fold_neighbour((k >> 6) & 3, s.inv_dy2, outlet_pressure, stencil);
+        stencil.inv_diagonal = (stencil.diagonal > 0.0) ? 1.0 / stencil.diagonal : 0.0;
+    }
+
+    const int imax = grid.domain().size_x;
+    const int jmax = grid.domain().size_y;
+    _stride = imax + 2;
+    _kind.assign(_stride * (jmax + 2), 0);
+    for (int j = 1; j <= jmax; ++j) {
+        for (int i = 1; i <= imax; ++i) {
+            if (!grid.is_fluid(i, j)) {
+                continue;
+            }
+            _kind[_stride * j + i] = neighbour_kind(grid, i + 1, j) | (neighbour_kind(grid, i - 1, j) << 2) |
+                                     (neighbour_kind(grid, i, j + 1) << 4) | (neighbour_kind(grid, i, j - 1) << 6);
+        }
+    }
+}
+
+void PressureSolver::fold_boundaries(const Grid &grid, double outlet_pressure) {
+    _operator = PressureOperator(grid, outlet_pressure);
+    _folded = true;
+}
+
+double PressureSolver::squared_residual(Fields &field, const Grid &grid) const {
+    const Stencil s = Discretization::stencil();
+    const auto &p = field.p_matrix();
+    const auto &rs = field.rs_matrix();
+
+    const auto rloc = grid.reduce_fluid_spans<1>(
+        [&](int j, int i_begin, int i_end) {
+            std::array<double, 1> row{};
+            if (_folded) {
+                for (int i = i_begin; i < i_end; ++i) {
+                    double val = _operator.laplacian(p, i, j) - rs(i, j);
+                    row[0] += (val * val);
+                }
+                return row;
+            }
+            for (int i = i_begin; i < i_end; ++i) {
+                double val = Discretization::laplacian<false>(p, i, j, s) - rs(i, j);
+                row[0] += (val * val);
+            }
+            return row;
+        },
+        std::plus<double>());
+
+    return rloc[0];
+}
+
 double Jacobi::solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<Boundary>> &boundaries) {
     double dx = grid.dx();
     double dy = grid.dy();
 
     double coeff = 1 / (2.0 * (1.0 / (dx * dx) + 1.0 / (dy * dy)));
-    int i, j;
-
-    auto p_old = field.p_matrix();
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            field.p(i, j) = coeff * (Discretization::sor_helper(p_old, i, j) - field.rs(i, j));
+    const Stencil s = Discretization::stencil();
+
+    auto &p = field.p_matrix();
+    const auto &rs = field.rs_matrix();
+    const int stride = p.imax();
+    const int rows = grid.domain().size_y;
+
+    // One pass over p instead of copy, sweep and residual: the old values of the
+    // rows j - 1 and j are kept in a two row ring, and the residual of row j - 1 is
+    // taken as soon as row j is updated. The rows next to another tile are saved
+    // before and finished after the sweep.
+    std::vector<double> row_residual(rows + 2, 0.0);
+    auto residual_row = [&](int j) {
+        double sum = 0.0;
+        grid.for_each_fluid_span_in_rows(j, j + 1, [&](int, int i_begin, int i_end) {
+            double partial = 0.0;
+            for (int i = i_begin; i < i_end; ++i) {
+                double val = (_folded ? _operator.laplacian(p, i, j) : Discretization::laplacian<false>(p, i, j, s)) -
+                             rs(i, j);
+                partial += (val * val);
+            }
+            sum += partial;
+        });
+        row_residual[j] = sum;
+    };
+
+    // old values of the rows below and above every tile
+    const auto &tiles = grid.fluid_tiles();
+    std::vector<double> edges(2 * tiles.size() * stride);
+    auto below_edge = [&](int k) { return edges.data() + 2 * k * stride; };
+    auto above_edge = [&](int k) { return edges.data() + (2 * k + 1) * stride; };
+    Threading::for_each_task(static_cast<int>(tiles.size()), [&](int k) {
+        std::copy(p.data() + (tiles[k].j_begin - 1) * stride, p.data() + tiles[k].j_begin * stride, below_edge(k));
+        std::copy(p.data() + tiles[k].j_end * stride, p.data() + (tiles[k].j_end + 1) * stride, above_edge(k));
+    });
+
+    Threading::for_each_task(static_cast<int>(tiles.size()), [&](int k) {
+        const int jb = tiles[k].j_begin;
+        const int je = tiles[k].j_end;
+        std::vector<double> ring(2 * stride);
+        auto old_row = [&](int j) { return ring.data() + (j & 1) * stride; };
+        std::copy(below_edge(k), below_edge(k) + stride, old_row(jb - 1));
+
+        for (int j = jb; j < je; ++j) {
+            double *row = p.data() + j * stride;
+            std::copy(row, row + stride, old_row(j));
+            const double *below = old_row(j - 1);
+            const double *centre = old_row(j);
+            const double *above = (j + 1 == je) ? above_edge(k) : row + stride;
+            grid.for_each_fluid_span_in_rows(j, j + 1, [&](int, int i_begin, int i_end) {
+                if (_folded) {
+                    for (int i = i_begin; i < i_end; ++i) {
+                        const PressureStencil &st = _operator.stencil(i, j);
+                        row[i] = st.inv_diagonal * (st.east * centre[i + 1] + st.west * centre[i - 1] +
+                                                    st.north * above[i] + st.south * below[i] + st.constant - rs(i, j));
+                    }
+                    return;
+                }
+                for (int i = i_begin; i < i_end; ++i) {
+                    double sor_helper = (centre[i + 1] + centre[i - 1]) * s.inv_dx2 + (above[i] + below[i]) * s.inv_dy2;
+                    row[i] = coeff * (sor_helper - rs(i, j));
+                }
+            });
+            if (j - 1 > jb) {
+                residual_row(j - 1);
+            }
         }
-    }
+    });
 
-    double res = 0.0;
-    double rloc = 0.0;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
+    grid.parallel_for_each_fluid_tile([&](int jb, int je) {
+        residual_row(jb);
+        if (je - 1 > jb) {
+            residual_row(je - 1);
         }
-    }
+    });
 
+    double rloc = 0.0;
+    for (double r : row_residual) {
+        rloc += r;
+    }
     return rloc;
 }
 
@@ -42,30 +188,21 @@ double SOR::solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<B
     double dy = grid.dy();
 
     double coeff = _omega / (2.0 * (1.0 / (dx * dx) + 1.0 / (dy * dy))); // = _omega * h^2 / 4.0, if dx == dy == h
-
-    int i, j;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            field.p(i, j) = (1.0 - _omega) * field.p(i, j) +
-                            coeff * (Discretization::sor_helper(field.p_matrix(), i, j) - field.rs(i, j));
-        }
-    }
-
-    double rloc = 0.0;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
-        }
+    const Stencil s = Discretization::stencil();
+
+    auto &p = field.p_matrix();
+    const auto &rs = field.rs_matrix();
+    if (_folded) {
+        grid.ordered_for_each_fluid_cell([&](int i, int j) {
+            p(i, j) = (1.0 - _omega) * p(i, j) + _omega * _operator.relaxed(p, rs, i, j);
+        });
+        return squared_residual(field, grid);
     }
+    grid.ordered_for_each_fluid_cell([&](int i, int j) {
+        p(i, j) = (1.0 - _omega) * p(i, j) + coeff * (Discretization::sor_helper<false>(p, i, j, s) - rs(i, j));
+    });
 
-    return rloc;
+    return squared_residual(field, grid);
 }
 
 WeightedJacobi::WeightedJacobi(double omega) : _omega(omega) {}
@@ -76,30 +213,148 @@ double WeightedJacobi::solve(Fields &field, Grid &grid, const std::vector<std::u
     double dy = grid.dy();
 
     double coeff = _omega / (2.0 * (1.0 / (dx * dx) + 1.0 / (dy * dy))); // = _omega * h^2 / 4.0, if dx == dy == h
+    const Stencil s = Discretization::stencil();
+
+    auto &p = field.p_matrix();
+    const auto &rs = field.rs_matrix();
+    auto p_old = p;
+    grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        if (_folded) {
+            for (int i = i_begin; i < i_end; ++i) {
+                p(i, j) = (1.0 - _omega) * p_old(i, j) + _omega * _operator.relaxed(p_old, rs, i, j);
+            }
+            return;
+        }
+        for (int i = i_begin; i < i_end; ++i) {
+            p(i, j) = (1.0 - _omega) * p_old(i, j) +
+                      coeff * (Discretization::sor_helper<false>(p_old, i, j, s) - rs(i, j));
+        }
+    });
+
+    return squared_residual(field, grid);
+}
+
+DeepHaloJacobi::DeepHaloJacobi(int depth) : _depth(depth) {}
+
+DeepHaloJacobi::DeepHaloJacobi(int depth, double omega) : _depth(depth), _omega(omega), _weighted(true) {}
+
+void DeepHaloJacobi::setup(const Grid &grid) {
+    const Domain &domain = grid.domain();
+    const int offset = _depth - 1;
+    const int imax = domain.size_x + 2 * _depth;
+    const int jmax = domain.size_y + 2 * _depth;
+    _p = Matrix<double>(imax, jmax, 0.0);
+    _p_next = Matrix<double>(imax, jmax, 0.0);
+    _rs = Matrix<double>(imax, jmax, 0.0);
 
-    int i, j;
-    auto p_old = field.p_matrix();
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            field.p(i, j) =
-                (1.0 - _omega) * p_old(i, j) + coeff * (Discretization::sor_helper(p_old, i, j) - field.rs(i, j));
+    // the kinds of the ghost cells are those the neighbours found for their own cells
+    _kinds = Matrix<double>(imax, jmax, -1.0);
+    for (const auto &span : grid.fluid_spans()) {
+        for (int i = span.i_begin; i < span.i_end; ++i) {
+            _kinds(i + offset, span.j + offset) = _operator.kind(i, span.j);
         }
     }
+    // a one-off exchange, its shared windows are allocated and freed by all processes of the node together
+    HaloExchange kinds_halo;
+    Communication::init_exchange({&_kinds}, domain, kinds_halo, _depth);
+    Communication::communicate(kinds_halo);
+    Communication::free_exchange(kinds_halo);
+
+    _spans.clear();
+    _row_spans.assign(jmax + 1, 0);
+    for (int j = 0; j < jmax; ++j) {
+        _row_spans[j] = static_cast<int>(_spans.size());
+        int i = 0;
+        while (i < imax) {
+            if (_kinds(i, j) < 0.0) {
+                ++i;
+                continue;
+            }
+            const int i_begin = i;
+            while (i < imax && _kinds(i, j) >= 0.0) {
+                ++i;
+            }
+            _spans.push_back(FluidSpan{j, i_begin, i});
+        }
+    }
+    _row_spans[jmax] = static_cast<int>(_spans.size());
 
-    double res = 0.0;
-    double rloc = 0.0;
+    Communication::init_exchange({&_p}, domain, _p_halo, _depth);
+    Communication::init_exchange({&_rs}, domain, _rs_halo, _depth);
+}
 
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
+double DeepHaloJacobi::solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<Boundary>> &boundaries) {
+    if (_p_halo.domain == nullptr) {
+        setup(grid);
+    }
+    const int offset = _depth - 1;
+    const int size_x = grid.domain().size_x;
+    const int size_y = grid.domain().size_y;
+    const int imax = _p.imax();
+    const int jmax = _p.jmax();
+
+    auto &p = field.p_matrix();
+    if (_new_rhs) {
+        const auto &rs = field.rs_matrix();
+        for (int j = 1; j <= size_y; ++j) {
+            std::copy(&rs(1, j), &rs(1, j) + size_x, &_rs(1 + offset, j + offset));
         }
+        Communication::communicate(_rs_halo);
+        _new_rhs = false;
+    }
+    for (int j = 1; j <= size_y; ++j) {
+        std::copy(&p(1, j), &p(1, j) + size_x, &_p(1 + offset, j + offset));
+    }
+    Communication::communicate(_p_halo);
+
+    // sweep s updates the cells [s, imax - s) x [s, jmax - s), down to the own cells in the last one
+    for (int sweep = 1; sweep <= _depth; ++sweep) {
+        const int first = sweep;
+        Threading::for_each_task(jmax - 2 * sweep, [&](int row) {
+            const int j = first + row;
+            for (int k = _row_spans[j]; k < _row_spans[j + 1]; ++k) {
+                const int i_begin = std::max(_spans[k].i_begin, first);
+                const int i_end = std::min(_spans[k].i_end, imax - first);
+                for (int i = i_begin; i < i_end; ++i) {
+                    const PressureStencil &st = _operator.stencil_of_kind(static_cast<unsigned char>(_kinds(i, j)));
+                    const double relaxed = st.inv_diagonal * (st.east * _p(i + 1, j) + st.west * _p(i - 1, j) +
+                                                              st.north * _p(i, j + 1) + st.south * _p(i, j - 1) +
+                                                              st.constant - _rs(i, j));
+                    _p_next(i, j) = _weighted ? (1.0 - _omega) * _p(i, j) + _omega * relaxed : relaxed;
+                }
+            }
+        });
+        std::swap(_p, _p_next);
+    }
+
+    // the ghost cells next to the own ones hold the previous iterate of the neighbours, as after a single sweep
+    std::vector<double> row_residual(size_y + 2, 0.0);
+    Threading::for_each_task(size_y, [&](int row) {
+        const int j = _depth + row;
+        double sum = 0.0;
+        for (int k = _row_spans[j]; k < _row_spans[j + 1]; ++k) {
+            const int i_begin = std::max(_spans[k].i_begin, _depth);
+            const int i_end = std::min(_spans[k].i_end, _depth + size_x);
+            double partial = 0.0;
+            for (int i = i_begin; i < i_end; ++i) {
+                const PressureStencil &st = _operator.stencil_of_kind(static_cast<unsigned char>(_kinds(i, j)));
+                double val = st.east * _p(i + 1, j) + st.west * _p(i - 1, j) + st.north * _p(i, j + 1) +
+                             st.south * _p(i, j - 1) + st.constant - st.diagonal * _p(i, j) - _rs(i, j);
+                partial += (val * val);
+            }
+            sum += partial;
+        }
+        row_residual[row + 1] = sum;
+    });
+
+    for (int j = 1; j <= size_y; ++j) {
+        std::copy(&_p(1 + offset, j + offset), &_p(1 + offset, j + offset) + size_x, &p(1, j));
     }
 
+    double rloc = 0.0;
+    for (double r : row_residual) {
+        rloc += r;
+    }
     return rloc;
 }
 
@@ -108,30 +363,19 @@ double GaussSeidel::solve(Fields &field, Grid &grid, const std::vector<std::uniq
     double dy = grid.dy();
 
     double coeff = 1.0 / (2.0 * (1.0 / (dx * dx) + 1.0 / (dy * dy))); // = h^2 / 4.0, if dx == dy == h
+    const Stencil s = Discretization::stencil();
 
-    int i, j;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            field.p(i, j) = coeff * (Discretization::sor_helper(field.p_matrix(), i, j) - field.rs(i, j));
-        }
-    }
-
-    double res = 0.0;
-    double rloc = 0.0;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
-        }
+    auto &p = field.p_matrix();
+    const auto &rs = field.rs_matrix();
+    if (_folded) {
+        grid.ordered_for_each_fluid_cell([&](int i, int j) { p(i, j) = _operator.relaxed(p, rs, i, j); });
+        return squared_residual(field, grid);
     }
+    grid.ordered_for_each_fluid_cell([&](int i, int j) {
+        p(i, j) = coeff * (Discretization::sor_helper<false>(p, i, j, s) - rs(i, j));
+    });
 
-    return rloc;
+    return squared_residual(field, grid);
 }
 
 Richardson::Richardson(double omega) : _omega(omega) {
@@ -142,34 +386,17 @@ Richardson::Richardson(double omega) : _omega(omega) {
 }
 
 double Richardson::solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<Boundary>> &boundaries) {
-    double dx = grid.dx();
-    double dy = grid.dy();
+    const Stencil s = Discretization::stencil();
 
-    int i, j;
-
-    auto p_old = field.p_matrix();
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            field.p(i, j) = p_old(i, j) + _omega * (field.rs(i, j) - Discretization::laplacian(field.p_matrix(), i, j));
-        }
-    }
+    auto &p = field.p_matrix();
+    const auto &rs = field.rs_matrix();
+    auto p_old = p;
+    grid.ordered_for_each_fluid_cell([&](int i, int j) {
+        const double laplacian = _folded ? _operator.laplacian(p, i, j) : Discretization::laplacian<false>(p, i, j, s);
+        p(i, j) = p_old(i, j) + _omega * (rs(i, j) - laplacian);
+    });
 
-    double res = 0.0;
-    double rloc = 0.0;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        i = currentCell->i();
-        j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
-        }
-    }
-
-    return rloc;
+    return squared_residual(field, grid);
 }
 
 GradientMethods::GradientMethods(Fields &field) {
@@ -182,23 +409,33 @@ GradientMethods::GradientMethods(Fields &field) {
 
 ConjugateGradient::ConjugateGradient(Fields &field) : GradientMethods(field) {}
 
+void ConjugateGradient::start_solve() { iter = 0; }
+
 double ConjugateGradient::solve(Fields &field, Grid &grid, const std::vector<std::unique_ptr<Boundary>> &boundaries) {
 
+    const Stencil s = Discretization::stencil();
     auto pressure = field.p_matrix();
-    auto rhs = field.rs_matrix();
+    const auto &rhs = field.rs_matrix();
+    auto &p = field.p_matrix();
 
     int imax, jmax;
 
     imax = field.p_matrix().imax();
     jmax = field.p_matrix().jmax();
 
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            residual(i, j) = rhs(i, j) - Discretization::laplacian(pressure, i, j);
+    // with the boundary conditions folded in, the search directions only see the linear part of the operator
+    auto laplacian = [&](const Matrix<double> &x, int i, int j) {
+        return _folded ? _operator.laplacian(x, i, j) : Discretization::laplacian<false>(x, i, j, s);
+    };
+    auto apply_linear = [&](const Matrix<double> &x, int i, int j) {
+        return _folded ? _operator.apply_linear(x, i, j) : Discretization::laplacian<false>(x, i, j, s);
+    };
+
+    grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        for (int i = i_begin; i < i_end; ++i) {
+            residual(i, j) = rhs(i, j) - laplacian(pressure, i, j);
         }
-    }
+    });
 
     if (iter == 0) {
         d = residual;
@@ -206,82 +443,69 @@ double ConjugateGradient::solve(Fields &field, Grid &grid, const std::vector<std
 
     Matrix<double> q(imax, jmax, 0.0);
 
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            q(i, j) =
-                Discretization::laplacian(d, i, j); // the q = Ad for this system would be laplacian of the d vector
-        }
-    }
-
-    double alpha_num = 0;
-    double alpha_den = 0;
     double alpha = 0;
 
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            alpha_num += residual(i, j) * residual(i, j); // num of alpha is delta_new = r^T * r
-            alpha_den += d(i, j) * q(i, j);               // den of alpha is d^T * q
-        }
-    }
+    // num of alpha is delta_new = r^T * r, den of alpha is d^T * q
+    const auto alpha_terms = grid.reduce_fluid_spans<2>(
+        [&](int j, int i_begin, int i_end) {
+            std::array<double, 2> row{};
+            for (int i = i_begin; i < i_end; ++i) {
+                // the q = Ad for this system would be laplacian of the d vector
+                q(i, j) = apply_linear(d, i, j);
+                row[0] += residual(i, j) * residual(i, j);
+                row[1] += d(i, j) * q(i, j);
+            }
+            return row;
+        },
+        std::plus<double>());
 
-    alpha = alpha_num / alpha_den;
+    alpha = alpha_terms[0] / alpha_terms[1];
 
-    double beta_den = 0;
-    double beta_num = 0;
     double beta = 0;
 
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-
-            field.p(i, j) = pressure(i, j) + alpha * d(i, j);
-            beta_den += residual(i, j) * residual(i, j);
-            if (iter == 50) {
-                iter = 0;
-                residual(i, j) = rhs(i, j) - Discretization::laplacian(pressure, i, j);
-            } else {
-                residual(i, j) -= alpha * q(i, j);
-            }
-            beta_num += residual(i, j) * residual(i, j);
-        }
+    // recompute the residual from scratch every 50 iterations. The folded operator does not change between the
+    // iterations and the residual is recomputed on every call anyway, so there the directions are kept.
+    const bool restart = !_folded && (iter == 50);
+    if (restart) {
+        iter = 0;
     }
 
-    beta = beta_num / beta_den;
+    const auto beta_terms = grid.reduce_fluid_spans<2>(
+        [&](int j, int i_begin, int i_end) {
+            std::array<double, 2> row{};
+            for (int i = i_begin; i < i_end; ++i) {
+                p(i, j) = pressure(i, j) + alpha * d(i, j);
+                row[0] += residual(i, j) * residual(i, j);
+                if (restart) {
+                    residual(i, j) = rhs(i, j) - laplacian(pressure, i, j);
+                } else {
+                    residual(i, j) -= alpha * q(i, j);
+                }
+                row[1] += residual(i, j) * residual(i, j);
+            }
+            return row;
+        },
+        std::plus<double>());
+
+    beta = beta_terms[1] / beta_terms[0];
 
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
+    grid.parallel_for_each_fluid_span([&](int j, int i_begin, int i_end) {
+        for (int i = i_begin; i < i_end; ++i) {
             d(i, j) = residual(i, j) + beta * d(i, j);
         }
-    }
+    });
 
     iter++;
 
-    double res = 0.0;
-    double rloc = 0.0;
-
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
-        }
-    }
-
-    return rloc;
+    return squared_residual(field, grid);
 }
 
-MultiGrid::MultiGrid(int user_levels, int iter1, int iter2)
-    : _max_multi_grid_level(user_levels), _smoothing_pre_recur(iter1), _smoothing_post_recur(iter2) {}
+MultiGrid::MultiGrid(int user_levels, int iter1, int iter2, int block_sweeps)
+    : _max_multi_grid_level(user_levels), _smoothing_pre_recur(iter1), _smoothing_post_recur(iter2),
+      _block_sweeps(block_sweeps) {}
 
-MultiGridVCycle::MultiGridVCycle(int user_levels, int iter1, int iter2) : MultiGrid(user_levels, iter1, iter2) {}
+MultiGridVCycle::MultiGridVCycle(int user_levels, int iter1, int iter2, int block_sweeps)
+    : MultiGrid(user_levels, iter1, iter2, block_sweeps) {}
 
 // MultiGridWCycle::MultiGridWCycle(int iter1, int iter2) : MultiGrid(iter1, iter2) {}
 
@@ -327,17 +551,7 @@ double MultiGridVCycle::solve(Fields &field, Grid &grid, const std::vector<std::
 
     field.p_matrix() = recursiveMultiGridCycle(field, p, rs, _max_multi_grid_level, dx, dy);
 
-    double rloc = 0.0;
-    for (auto currentCell : grid.fluid_cells()) {
-        int i = currentCell->i();
-        int j = currentCell->j();
-        if (i != 0 && j != 0 && i != grid.domain().size_x + 1 && j != grid.domain().size_y + 1) {
-            double val = Discretization::laplacian(field.p_matrix(), i, j) - field.rs(i, j);
-            rloc += (val * val);
-        }
-    }
-
-    return rloc;
+    return squared_residual(field, grid);
 };
 
 // Matrix<double> MultiGridWCycle::recursiveMultiGridCycle(Fields &field, Matrix<double> p, Matrix<double> rs,
@@ -407,6 +621,7 @@ Matrix<double> MultiGridVCycle::recursiveMultiGridCycle(Fields &field, Matrix<do
 
         auto error_fine = prolongator(error);
 
+#pragma omp parallel for
         for (int i = 0; i < error_fine.imax(); ++i) {
             for (int j = 0; j < error_fine.jmax(); ++j) {
                 p(i, j) = p(i, j) + error_fine(i, j);
@@ -424,6 +639,7 @@ Matrix<double> MultiGrid::residual(Matrix<double> p, Matrix<double> rs, double d
 
     auto residuals = Matrix<double>(imax + 2, jmax + 2, 0.0);
 
+#pragma omp parallel for
     for (int i = 1; i <= imax; i++) {
         for (int j = 1; j <= jmax; j++) {
             auto helper = (p(i + 1, j) - 2.0 * p(i, j) + p(i - 1, j)) / (dx * dx) +
@@ -439,33 +655,81 @@ Matrix<double> MultiGrid::smoother(Matrix<double> error, Matrix<double> rs, int
     int imax = error.imax() - 2;
     int jmax = error.jmax() - 2;
 
-    double coeff = 1 / (2.0 * (1.0 / (dx * dx) + 1.0 / (dy * dy)));
+    const int depth = std::max(1, _block_sweeps);
 
     auto error_new = error;
-    for (int it = 0; it < iter; ++it) {
-        for (int j = 1; j <= jmax; ++j) {
-            for (int i = 1; i <= imax; ++i) {
-                auto sor_helper =
-                    (error(i + 1, j) + error(i - 1, j)) / (dx * dx) + (error(i, j + 1) + error(i, j - 1)) / (dy * dy);
-                error_new(i, j) = coeff * (sor_helper - rs(i, j));
-            }
-        }
+    for (int done = 0; done < iter; done += depth) {
+        blocked_jacobi_pass(error, error_new, rs, std::min(depth, iter - done), dx, dy);
 
-        // Hardcoded boundary conditions for LidDrivenCavity (Neumann boundary condition)
+        // Hardcoded boundary conditions for LidDrivenCavity (Neumann boundary condition),
+        // the left and right ones are set row by row during the pass
         for (int i = 1; i <= imax; i++) {
             error_new(i, 0) = error_new(i, 1);
             error_new(i, jmax + 1) = error_new(i, jmax);
         }
 
-        for (int j = 1; j <= jmax; j++) {
-            error_new(0, j) = error_new(1, j);
-            error_new(imax + 1, j) = error_new(imax, j);
-        }
-
-        error = error_new;
+        std::swap(error, error_new);
     }
 
-    return error_new;
+    return error;
+}
+
+void MultiGrid::blocked_jacobi_pass(const Matrix<double> &in, Matrix<double> &out, const Matrix<double> &rs,
+                                    int sweeps, double dx, double dy) {
+    const int imax = in.imax() - 2;
+    const int jmax = in.jmax() - 2;
+    const int stride = in.imax();
+
+    double coeff = 1 / (2.0 * (1.0 / (dx * dx) + 1.0 / (dy * dy)));
+
+    // Row wavefront: at step t, sweep s updates row t - s + 1 from the three rows of
+    // sweep s - 1 around it. The intermediate sweeps only live in a ring of three
+    // rows each, so every sweep after the first reads from cache. The Neumann ghost
+    // values of a sweep are taken from the adjacent row/column of the same sweep.
+    // Threads take column blocks widened by the sweeps still to come, which they
+    // compute redundantly with their neighbours.
+#pragma omp parallel
+    {
+        const auto cols = Threading::block(1, imax + 1);
+        const int i0 = cols.first;
+        const int i1 = cols.second;
+        std::vector<double> ring((sweeps > 1 && i0 < i1) ? 3 * (sweeps - 1) * stride : 0);
+        auto level_row = [&](int level, int j) { return ring.data() + (3 * (level - 1) + j % 3) * stride; };
+
+        for (int t = 1; i0 < i1 && t <= jmax + sweeps - 1; ++t) {
+            for (int level = 1; level <= sweeps; ++level) {
+                const int j = t - level + 1;
+                if (j < 1 || j > jmax) {
+                    continue;
+                }
+                const int lo = std::max(1, i0 - (sweeps - level));
+                const int hi = std::min(imax + 1, i1 + (sweeps - level));
+
+                const double *below, *centre, *above;
+                if (level == 1) {
+                    centre = in.data() + j * stride;
+                    below = centre - stride;
+                    above = centre + stride;
+                } else {
+                    centre = level_row(level - 1, j);
+                    below = (j == 1) ? centre : level_row(level - 1, j - 1);
+                    above = (j == jmax) ? centre : level_row(level - 1, j + 1);
+                }
+                double *dest = (level == sweeps) ? out.data() + j * stride : level_row(level, j);
+
+                for (int i = lo; i < hi; ++i) {
+                    auto sor_helper = (centre[i + 1] + centre[i - 1]) / (dx * dx) + (above[i] + below[i]) / (dy * dy);
+                    dest[i] = coeff * (sor_helper - rs(i, j));
+                }
+                if (lo == 1) {
+                    dest[0] = dest[1];
+                }
+                if (hi == imax + 1) {
+                    dest[imax + 1] = dest[imax];
+                }
+            }
+        }
+    }
 }
 
 Matrix<double> MultiGrid::restrictor(Matrix<double> fine) {
@@ -475,6 +739,7 @@ Matrix<double> MultiGrid::restrictor(Matrix<double> fine) {
     Matrix<double> coarse = Matrix<double>(imax + 2, jmax + 2, 0.0);
 
     // Slide 57 from https://www.math.hkust.edu.hk/~mawang/teaching/math532/mgtut.pdf
+#pragma omp parallel for
     for (int i = 1; i <= imax; ++i) {
         for (int j = 1; j <= jmax; ++j) {
             coarse(i, j) = 0.25 * fine(2 * i, 2 * j) +
@@ -508,6 +773,7 @@ Matrix<double> MultiGrid::prolongator(Matrix<double> coarse) {
 
     // Slide 56 from https://www.math.hkust.edu.hk/~mawang/teaching/math532/mgtut.pdf
 
+#pragma omp parallel for
     for (int i = 0; i <= imax; i++) {
         for (int j = 0; j <= jmax; j++) {
             fine(2 * i, 2 * j) = coarse(i, j);
@@ -0,0 +1,106 @@
+#include "SimdKernels.hpp"
+
+namespace {
+
+/// whether the CPU we are running on executes the instruction set
+bool cpu_supports(simd_isa isa) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    switch (isa) {
+    case simd_isa::SCALAR:
+        return true;
+    case simd_isa::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case simd_isa::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case simd_isa::AVX512:
+        return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    return isa == simd_isa::SCALAR;
+#endif
+}
+
+/// whether the build contains kernels for the instruction set
+bool compiled(simd_isa isa) {
+    switch (isa) {
+    case simd_isa::SCALAR:
+        return true;
+    case simd_isa::SSE2:
+        return flux_row_sse2(false) != nullptr;
+    case simd_isa::AVX2:
+        return flux_row_avx2(false) != nullptr;
+    case simd_isa::AVX512:
+        return flux_row_avx512(false) != nullptr;
+    }
+    return false;
+}
+
+} // namespace
+
+bool SimdKernels::available(simd_isa isa) { return compiled(isa) && cpu_supports(isa); }
+
+simd_isa SimdKernels::detect() {
+    for (auto isa : {simd_isa::AVX512, simd_isa::AVX2, simd_isa::SSE2}) {
+        if (available(isa)) {
+            return isa;
+        }
+    }
+    return simd_isa::SCALAR;
+}
+
+simd_isa SimdKernels::select(const std::string &request) {
+    simd_isa isa;
+    if (request == "scalar") {
+        isa = simd_isa::SCALAR;
+    } else if (request == "sse2") {
+        isa = simd_isa::SSE2;
+    } else if (request == "avx2") {
+        isa = simd_isa::AVX2;
+    } else if (request == "avx512") {
+        isa = simd_isa::AVX512;
+    } else {
+        return detect();
+    }
+    return available(isa) ? isa : detect();
+}
+
+FluxRowKernel SimdKernels::flux_row(simd_isa isa, bool energy) {
+    switch (isa) {
+    case simd_isa::SSE2:
+        return flux_row_sse2(energy);
+    case simd_isa::AVX2:
+        return flux_row_avx2(energy);
+    case simd_isa::AVX512:
+        return flux_row_avx512(energy);
+    default:
+        return nullptr;
+    }
+}
+
+TemperatureRowKernel SimdKernels::temperature_row(simd_isa isa) {
+    switch (isa) {
+    case simd_isa::SSE2:
+        return temperature_row_sse2();
+    case simd_isa::AVX2:
+        return temperature_row_avx2();
+    case simd_isa::AVX512:
+        return temperature_row_avx512();
+    default:
+        return nullptr;
+    }
+}
+
+std::string SimdKernels::name(simd_isa isa) {
+    switch (isa) {
+    case simd_isa::SSE2:
+        return "sse2";
+    case simd_isa::AVX2:
+        return "avx2";
+    case simd_isa::AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,39 @@
+#include "SimdKernels.hpp"
+
+// compiled with -mavx2 -mfma, see CMakeLists.txt
+#if defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+#include "SimdRowKernels.hpp"
+
+namespace {
+
+/// Four doubles per register
+struct Avx2Lane {
+    using type = __m256d;
+    static constexpr int width = 4;
+    static type load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, type a) { _mm256_storeu_pd(p, a); }
+    static type set1(double a) { return _mm256_set1_pd(a); }
+    static type add(type a, type b) { return _mm256_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+    static type abs(type a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+};
+
+} // namespace
+
+FluxRowKernel flux_row_avx2(bool energy) {
+    return energy ? &flux_row<Avx2Lane, true> : &flux_row<Avx2Lane, false>;
+}
+
+TemperatureRowKernel temperature_row_avx2() { return &temperature_row<Avx2Lane>; }
+
+#else
+
+FluxRowKernel flux_row_avx2(bool) { return nullptr; }
+
+TemperatureRowKernel temperature_row_avx2() { return nullptr; }
+
+#endif
@@ -0,0 +1,40 @@
+#include "SimdKernels.hpp"
+
+// compiled with -mavx512f, see CMakeLists.txt
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+#include "SimdRowKernels.hpp"
+
+namespace {
+
+/// Eight doubles per register
+struct Avx512Lane {
+    using type = __m512d;
+    static constexpr int width = 8;
+    static type load(const double *p) { return _mm512_loadu_pd(p); }
+    static void store(double *p, type a) { _mm512_storeu_pd(p, a); }
+    static type set1(double a) { return _mm512_set1_pd(a); }
+    static type add(type a, type b) { return _mm512_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm512_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm512_mul_pd(a, b); }
+    // _mm512_andnot_pd needs AVX512DQ, the abs intrinsic only AVX512F
+    static type abs(type a) { return _mm512_abs_pd(a); }
+};
+
+} // namespace
+
+FluxRowKernel flux_row_avx512(bool energy) {
+    return energy ? &flux_row<Avx512Lane, true> : &flux_row<Avx512Lane, false>;
+}
+
+TemperatureRowKernel temperature_row_avx512() { return &temperature_row<Avx512Lane>; }
+
+#else
+
+FluxRowKernel flux_row_avx512(bool) { return nullptr; }
+
+TemperatureRowKernel temperature_row_avx512() { return nullptr; }
+
+#endif
@@ -0,0 +1,38 @@
+#include "SimdKernels.hpp"
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#include "SimdRowKernels.hpp"
+
+namespace {
+
+/// Two doubles per register
+struct Sse2Lane {
+    using type = __m128d;
+    static constexpr int width = 2;
+    static type load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, type a) { _mm_storeu_pd(p, a); }
+    static type set1(double a) { return _mm_set1_pd(a); }
+    static type add(type a, type b) { return _mm_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+    static type abs(type a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+};
+
+} // namespace
+
+FluxRowKernel flux_row_sse2(bool energy) {
+    return energy ? &flux_row<Sse2Lane, true> : &flux_row<Sse2Lane, false>;
+}
+
+TemperatureRowKernel temperature_row_sse2() { return &temperature_row<Sse2Lane>; }
+
+#else
+
+FluxRowKernel flux_row_sse2(bool) { return nullptr; }
+
+TemperatureRowKernel temperature_row_sse2() { return nullptr; }
+
+#endif
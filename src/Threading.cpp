@@ -0,0 +1,96 @@
+#include "Threading.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void Threading::set_num_threads(int threads) {
+#ifdef _OPENMP
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+#endif
+}
+
+int Threading::num_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+std::pair<int, int> Threading::block(int first, int last) {
+#ifdef _OPENMP
+    const int threads = omp_get_num_threads();
+    const int id = omp_get_thread_num();
+#else
+    const int threads = 1;
+    const int id = 0;
+#endif
+    const int n = last - first;
+    const int chunk = n / threads;
+    const int rest = n % threads;
+    const int begin = first + id * chunk + (id < rest ? id : rest);
+    return {begin, begin + chunk + (id < rest ? 1 : 0)};
+}
+
+int Threading::thread_id() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+namespace {
+std::uint64_t pack(std::uint64_t front, std::uint64_t back) { return front << 32 | back; }
+int front(std::uint64_t range) { return static_cast<int>(range >> 32); }
+int back(std::uint64_t range) { return static_cast<int>(range & 0xFFFFFFFFu); }
+} // namespace
+
+TaskQueue::TaskQueue(int tasks, int threads) : _deques(threads) {
+    const int chunk = tasks / threads;
+    const int rest = tasks % threads;
+    for (int id = 0; id < threads; ++id) {
+        const int begin = id * chunk + (id < rest ? id : rest);
+        const int end = begin + chunk + (id < rest ? 1 : 0);
+        _deques[id].range.store(pack(begin, end), std::memory_order_relaxed);
+    }
+}
+
+bool TaskQueue::pop_front(Deque &deque, int &task) {
+    std::uint64_t range = deque.range.load(std::memory_order_relaxed);
+    while (front(range) < back(range)) {
+        if (deque.range.compare_exchange_weak(range, pack(front(range) + 1, back(range)))) {
+            task = front(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskQueue::pop_back(Deque &deque, int &task) {
+    std::uint64_t range = deque.range.load(std::memory_order_relaxed);
+    while (front(range) < back(range)) {
+        if (deque.range.compare_exchange_weak(range, pack(front(range), back(range) - 1))) {
+            task = back(range) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskQueue::next(int thread, int &task) {
+    const int threads = static_cast<int>(_deques.size());
+    if (thread < threads && pop_front(_deques[thread], task)) {
+        return true;
+    }
+    // steal from the other deques, starting with the next thread's
+    for (int k = 1; k <= threads; ++k) {
+        if (pop_back(_deques[(thread + k) % threads], task)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,44 @@
+#include <cmath>
+
+#include "Boundary.hpp"
+#include "Communication.hpp"
+#include "Enums.hpp"
+#include "Fields.hpp"
+#include "Grid.hpp"
+#include "TestUtils.hpp"
+
+// The implicit diffusion timestep of the lid driven cavity has to go past the explicit diffusive limit
+int main(int argn, char **args) {
+    int rank, size;
+    Communication::init_parallel(&argn, args, rank, size);
+
+    // example_cases/LidDrivenCavity: the diffusive limit 0.01 is below the convective one 0.02
+    const int cells = 50;
+    const double nu = 0.01;
+    const double tau = 0.5;
+    Domain domain = TestUtils::lid_driven_cavity_domain(cells);
+    Grid grid("NONE", domain);
+    const double dx = grid.dx();
+    const double explicit_dt = tau * 0.5 * dx * dx / (2.0 * nu);
+    const double convective_dt = tau * dx / LidDrivenCavity::wall_velocity;
+
+    for (const bool implicit : {false, true}) {
+        Fields field(grid, nu, 0.05, tau, 0.0, 0.0, "off", cells, cells, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        field.set_implicit_diffusion(grid, implicit);
+        field.set_driving_velocity(LidDrivenCavity::wall_velocity);
+        // the ghost cells above the resting fluid hold twice the lid velocity
+        MovingWallBoundary lid(grid.moving_wall_cells(), LidDrivenCavity::wall_velocity);
+        lid.compile(field, grid);
+        lid.apply(field);
+        const double dt = field.calculate_dt(grid);
+        if (implicit) {
+            TestUtils::check(dt > 1.5 * explicit_dt, "the implicit dt goes past the explicit diffusive limit");
+            TestUtils::check(std::abs(dt - convective_dt) < 1e-12, "the implicit dt follows the lid velocity");
+        } else {
+            TestUtils::check(std::abs(dt - explicit_dt) < 1e-12, "the explicit dt is the diffusive limit");
+        }
+    }
+
+    Communication::finalize();
+    return TestUtils::failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#include <cmath>
+#include <limits>
+
+#include "Communication.hpp"
+#include "Fields.hpp"
+#include "Grid.hpp"
+#include "TestUtils.hpp"
+
+// Feeds changing, steady and NaN fields to the steady state monitor of Fields
+int main(int argn, char **args) {
+    int rank, size;
+    Communication::init_parallel(&argn, args, rank, size);
+
+    Domain domain = TestUtils::lid_driven_cavity_domain(8);
+    Grid grid("NONE", domain);
+    Fields field(grid, 0.01, 0.05, 0.5, 0.0, 0.0, "off", 8, 8, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+    const double dt = 0.05;
+
+    TestUtils::check(std::isinf(Fields::state_change_rate(field.state_change(grid), dt)),
+                     "the first sample is an infinite change");
+
+    field.u(4, 4) = 1.5;
+    field.u(4, 5) = 1.0;
+    field.state_change(grid);
+    field.u(4, 5) = 1.5;
+    const double rate = Fields::state_change_rate(field.state_change(grid), dt);
+    TestUtils::check(std::abs(rate - 0.5 / 1.5 / dt) < 1e-12, "the change is relative to the largest magnitude");
+
+    TestUtils::check(Fields::state_change_rate(field.state_change(grid), dt) == 0.0, "an unchanged field is steady");
+
+    field.u(4, 4) = 0.0;
+    field.u(4, 5) = 0.0;
+    TestUtils::check(std::isinf(Fields::state_change_rate(field.state_change(grid), dt)),
+                     "a field dropping to zero is an infinite change");
+
+    field.u(3, 5) = std::numeric_limits<double>::quiet_NaN();
+    TestUtils::check(std::isnan(Fields::state_change_rate(field.state_change(grid), dt)),
+                     "a NaN field is reported as diverged");
+    TestUtils::check(std::isnan(Fields::state_change_rate(field.state_change(grid), dt)),
+                     "a NaN field stays diverged");
+
+    field.u(3, 5) = 0.0;
+    field.p(2, 2) = std::numeric_limits<double>::infinity();
+    TestUtils::check(std::isnan(Fields::state_change_rate(field.state_change(grid), dt)),
+                     "an infinite field is reported as diverged");
+
+    Communication::finalize();
+    return TestUtils::failures == 0 ? 0 : 1;
+}
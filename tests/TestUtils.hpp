@@ -0,0 +1,49 @@
+#pragma once
+
+#include <iostream>
+
+#include "Domain.hpp"
+
+/**
+ * @brief Helpers shared by the unit tests in this directory
+ *
+ * Every test is a small program that returns a non-zero exit code if one of
+ * its checks failed, so that CTest reports it.
+ */
+namespace TestUtils {
+
+/// number of failed checks so far
+inline int failures = 0;
+
+/// records a failed check with its description
+inline void check(bool condition, const char *description) {
+    if (!condition) {
+        std::cerr << "FAILED: " << description << std::endl;
+        failures += 1;
+    }
+}
+
+/**
+ * @brief Domain of a lid driven cavity on the unit square, undecomposed
+ *
+ * @param cells number of cells in x and y direction
+ * @return Domain of a single process covering the whole cavity
+ */
+inline Domain lid_driven_cavity_domain(int cells) {
+    Domain domain;
+    domain.imin = 0;
+    domain.imax = cells + 2;
+    domain.jmin = 0;
+    domain.jmax = cells + 2;
+    domain.dx = 1.0 / cells;
+    domain.dy = 1.0 / cells;
+    domain.size_x = cells;
+    domain.size_y = cells;
+    domain.domain_size_x = cells;
+    domain.domain_size_y = cells;
+    domain.x_cuts = {0, cells};
+    domain.y_cuts = {0, cells};
+    return domain;
+}
+
+} // namespace TestUtils